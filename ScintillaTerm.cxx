@@ -5,16 +5,29 @@
 // Note: setlocale(LC_CTYPE, "") must be called before initializing curses in
 // order to display UTF-8 characters properly in ncursesw.
 
+#include <ctype.h>
 #include <math.h>
 #include <stdint.h>
+#include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <wchar.h>
+#if !_WIN32
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <signal.h>
+#include <unistd.h>
+#include <sys/wait.h>
+#endif
 
 #include <stdexcept>
 #include <string>
 #include <vector>
 #include <map>
+#include <list>
+#include <deque>
+#include <bitset>
 #include <algorithm>
 
 #include "Platform.h"
@@ -86,10 +99,15 @@ struct ldat {
   NCURSES_SIZE_T lastchar;
   NCURSES_SIZE_T oldindex;
 };
+#define wrowget(w, y) (w)->_line[(y)].text
 #elif PDCURSES
 #define wattrget(w, y, x) (w)->_y[(y)][(x)]
+#define wrowget(w, y) (w)->_y[(y)]
+#define NCURSES_CH_T chtype
 #else
 #define wattrget(w, y, x) 0
+#define wrowget(w, y) static_cast<NCURSES_CH_T *>(NULL)
+#define NCURSES_CH_T chtype
 #endif
 
 #if _WIN32
@@ -245,19 +263,19 @@ static int term_color(int color) { return color; }
 class SurfaceImpl : public Surface {
   WINDOW *win;
   PRectangle clip;
-
+public:
   /**
    * Returns the number of columns used to display the first UTF-8 character in
    * `s`, taking into account zero-width combining characters.
    * @param s The string that contains the first UTF-8 character to display.
    */
-  int grapheme_width(const char *s) {
+  static int grapheme_width(const char *s) {
     wchar_t wch;
     if (mbtowc(&wch, s, MB_CUR_MAX) < 1) return 1;
     int width = wcwidth(wch);
     return width >= 0 ? width : 1;
   }
-public:
+
   /** Allocates a new Scintilla surface for the terminal. */
   SurfaceImpl() : win(0) {}
   /** Deletes the surface. */
@@ -931,6 +949,1476 @@ int Platform::Clamp(int val, int minVal, int maxVal) {
   return val;
 }
 
+// Document watching.
+
+/**
+ * Watches a Scintilla document independently of any Scintilla instance
+ * showing it.
+ * Subclasses only need to handle the notifications they are interested in.
+ * When the document is deleted, the watcher stays alive but is detached from
+ * it.
+ */
+class DocumentWatcher : public DocWatcher {
+protected:
+  Document *doc; // the watched document, or NULL if it was deleted
+public:
+  /** Starts watching the given document. */
+  DocumentWatcher(Document *doc_) : doc(doc_) { doc->AddWatcher(this, 0); }
+  /** Stops watching the document. */
+  virtual ~DocumentWatcher() { if (doc) doc->RemoveWatcher(this, 0); }
+  void NotifyModifyAttempt(Document *document, void *userData) {}
+  void NotifySavePoint(Document *document, void *userData, bool atSavePoint) {}
+  void NotifyModified(Document *document, DocModification mh,
+                      void *userData) {}
+  /**
+   * Detaches from the deleted document.
+   * The watcher must not be removed from the document here since the document
+   * is iterating over its watchers.
+   */
+  void NotifyDeleted(Document *document, void *userData) { doc = 0; }
+  void NotifyStyleNeeded(Document *document, void *userData, int endPos) {}
+  void NotifyLexerChanged(Document *document, void *userData) {}
+  void NotifyErrorOccurred(Document *document, void *userData, int status) {}
+};
+
+/**
+ * A bounded log of the edits made to a document, tagged with a document
+ * version that increases with each edit.
+ * Consumers ask for all changes since a version they have seen and receive a
+ * merged list of changes to apply in order. When the log grows beyond its size
+ * limit, its oldest changes are dropped and consumers that have not seen them
+ * need to resynchronize with the document's full text.
+ */
+class ChangeLog : public DocumentWatcher {
+  /** An edit that produced a document version. */
+  struct Change {
+    int version, position, deleted;
+    std::string inserted;
+  };
+  std::deque<Change> changes; // changes in version order
+  size_t size, maxSize; // current and maximum byte size of the log
+  int version; // the document's current version
+  int firstVersion; // the oldest version changes can be retrieved since
+  std::vector<Change> merged; // the changes last retrieved
+  std::vector<ScintillaChange> results; // merged changes for C callers
+
+  /**
+   * Merges the given change into the given preceding change, if possible.
+   * This is possible when the change touches the text the preceding change
+   * inserted.
+   * @return whether or not the change was merged
+   */
+  static bool Merge(Change &prev, const Change &next) {
+    int prevEnd = prev.position + static_cast<int>(prev.inserted.length());
+    if (next.position > prevEnd || next.position + next.deleted < prev.position)
+      return false;
+    int offset = next.position - prev.position; // start within prev.inserted
+    int end = Platform::Clamp(offset + next.deleted, 0,
+                              prev.inserted.length()); // end within it
+    prev.deleted += Platform::Maximum(-offset, 0) +
+                    Platform::Maximum(next.position + next.deleted - prevEnd,
+                                      0);
+    offset = Platform::Maximum(offset, 0);
+    prev.inserted = prev.inserted.substr(0, offset) + next.inserted +
+                    prev.inserted.substr(Platform::Maximum(end, offset));
+    prev.position = Platform::Minimum(prev.position, next.position);
+    return true;
+  }
+public:
+  /**
+   * Creates a new change log for the given document.
+   * @param doc_ The document to log changes of.
+   * @param maxSize_ The maximum number of bytes the log may use.
+   */
+  ChangeLog(Document *doc_, int maxSize_) : DocumentWatcher(doc_), size(0),
+    maxSize(Platform::Maximum(maxSize_, 0)), version(0), firstVersion(0) {}
+
+  /** Records insertions and deletions as new document versions. */
+  void NotifyModified(Document *document, DocModification mh,
+                      void *userData) {
+    if (!(mh.modificationType & (SC_MOD_INSERTTEXT | SC_MOD_DELETETEXT)))
+      return;
+    Change change;
+    change.version = ++version, change.position = mh.position;
+    change.deleted = (mh.modificationType & SC_MOD_DELETETEXT) ? mh.length : 0;
+    if (mh.modificationType & SC_MOD_INSERTTEXT)
+      change.inserted.assign(mh.text, mh.length);
+    changes.push_back(change);
+    size += sizeof(Change) + change.inserted.length();
+    while (size > maxSize && !changes.empty()) {
+      size -= sizeof(Change) + changes.front().inserted.length();
+      firstVersion = changes.front().version;
+      changes.pop_front();
+    }
+  }
+  /** Returns the document's current version. */
+  int GetVersion() { return version; }
+  /**
+   * Returns the number of changes made since the given version, merging
+   * adjacent changes where possible, and points the given pointer at them.
+   * The changes are valid until the next call or until the log is deleted.
+   * @param since The version to get changes since.
+   * @param changes_ The pointer to point at the changes.
+   * @return number of changes, or `-1` if the changes since the given version
+   *   are no longer available or the document was deleted
+   */
+  int GetChanges(int since, const ScintillaChange **changes_) {
+    *changes_ = 0;
+    if (!doc || since < firstVersion || since > version) return -1;
+    merged.clear(), results.clear();
+    for (std::deque<Change>::iterator it = changes.begin();
+         it != changes.end(); ++it)
+      if (it->version > since && (merged.empty() || !Merge(merged.back(), *it)))
+        merged.push_back(*it);
+    for (size_t i = 0; i < merged.size(); i++) {
+      ScintillaChange result = {
+        merged[i].position, merged[i].deleted,
+        static_cast<int>(merged[i].inserted.length()),
+        merged[i].inserted.c_str()
+      };
+      results.push_back(result);
+    }
+    if (!results.empty()) *changes_ = &results[0];
+    return static_cast<int>(results.size());
+  }
+};
+
+/**
+ * A set of positions in a document that follow the document's edits.
+ * Positions are kept in treaps ordered by position, one for each gravity, with
+ * lazily propagated shifts so that each edit updates all positions in
+ * logarithmic time.
+ * Positions in deleted text move to the start of the deletion. A position at
+ * an insertion point stays before the inserted text if it has left gravity and
+ * moves after it if it has right gravity.
+ */
+class PositionTracker : public DocumentWatcher {
+  /** A tracked position and its treap links. */
+  struct Node {
+    int left, right, parent; // node indices, or -1
+    unsigned int priority;
+    int pos; // position, valid once the ancestors' pending shifts are pushed
+    bool hasSet; // whether or not descendants are pending a move to setTo
+    int setTo; // pending position for all descendants
+    int add; // pending shift for all descendants
+    bool rightGravity, used;
+  };
+  std::vector<Node> nodes; // indexed by position ID
+  std::vector<int> freeNodes; // IDs of removed positions available for reuse
+  int roots[2]; // treap roots for left and right gravity positions
+  unsigned int seed; // for treap priorities
+
+  /** Moves or shifts the given subtree's root and marks its descendants. */
+  void Apply(int t, bool set, int value) {
+    if (t < 0) return;
+    Node &node = nodes[t];
+    if (set)
+      node.pos = value, node.hasSet = true, node.setTo = value, node.add = 0;
+    else if (node.pos += value, node.hasSet)
+      node.setTo += value;
+    else
+      node.add += value;
+  }
+  /** Applies the given node's pending move or shift to its children. */
+  void Push(int t) {
+    Node &node = nodes[t];
+    if (node.hasSet)
+      Apply(node.left, true, node.setTo), Apply(node.right, true, node.setTo);
+    else if (node.add)
+      Apply(node.left, false, node.add), Apply(node.right, false, node.add);
+    node.hasSet = false, node.add = 0;
+  }
+  void SetLeft(int t, int child) {
+    if ((nodes[t].left = child) >= 0) nodes[child].parent = t;
+  }
+  void SetRight(int t, int child) {
+    if ((nodes[t].right = child) >= 0) nodes[child].parent = t;
+  }
+  void SetRoot(bool rightGravity, int t) {
+    if ((roots[rightGravity] = t) >= 0) nodes[t].parent = -1;
+  }
+  /**
+   * Splits the given subtree into positions before the given key (or at it, if
+   * inclusive is true) and the rest.
+   */
+  void Split(int t, int key, bool inclusive, int &l, int &r) {
+    if (t < 0) {
+      l = r = -1;
+      return;
+    }
+    Push(t);
+    int sub;
+    if (nodes[t].pos < key || (inclusive && nodes[t].pos == key))
+      Split(nodes[t].right, key, inclusive, sub, r), SetRight(t, sub), l = t;
+    else
+      Split(nodes[t].left, key, inclusive, l, sub), SetLeft(t, sub), r = t;
+  }
+  /** Merges the given subtrees, all of whose positions are ordered. */
+  int Merge(int l, int r) {
+    if (l < 0 || r < 0) return (l >= 0) ? l : r;
+    if (nodes[l].priority > nodes[r].priority)
+      return (Push(l), SetRight(l, Merge(nodes[l].right, r)), l);
+    else
+      return (Push(r), SetLeft(r, Merge(l, nodes[r].left)), r);
+  }
+  /** Pushes all pending shifts down to the given node so its position is up to
+   * date. */
+  void Resolve(int t) {
+    std::vector<int> path;
+    for (int p = nodes[t].parent; p >= 0; p = nodes[p].parent)
+      path.push_back(p);
+    for (int i = static_cast<int>(path.size()) - 1; i >= 0; i--)
+      Push(path[i]);
+  }
+  /** Appends the given subtree's positions in order. */
+  void Collect(int t, std::vector<std::pair<int, int> > &out) {
+    if (t < 0) return;
+    Push(t);
+    Collect(nodes[t].left, out);
+    out.push_back(std::make_pair(nodes[t].pos, t));
+    Collect(nodes[t].right, out);
+  }
+  bool Valid(int id) {
+    return id >= 0 && id < static_cast<int>(nodes.size()) && nodes[id].used;
+  }
+public:
+  /** Creates a new, empty position tracker for the given document. */
+  PositionTracker(Document *doc_) : DocumentWatcher(doc_), seed(2463534242u) {
+    roots[0] = roots[1] = -1;
+  }
+
+  /** Shifts positions after insertions and collapses deleted ones. */
+  void NotifyModified(Document *document, DocModification mh,
+                      void *userData) {
+    int l, m, r;
+    if (mh.modificationType & SC_MOD_INSERTTEXT)
+      for (int g = 0; g < 2; g++) {
+        Split(roots[g], mh.position, g == 0, l, r);
+        Apply(r, false, mh.length), SetRoot(g, Merge(l, r));
+      }
+    else if (mh.modificationType & SC_MOD_DELETETEXT)
+      for (int g = 0; g < 2; g++) {
+        Split(roots[g], mh.position, false, l, r);
+        Split(r, mh.position + mh.length, false, m, r);
+        Apply(m, true, mh.position), Apply(r, false, -mh.length);
+        SetRoot(g, Merge(Merge(l, m), r));
+      }
+  }
+  /**
+   * Starts tracking the given position and returns its ID.
+   * IDs of removed positions are reused.
+   */
+  int Add(int pos, bool rightGravity) {
+    pos = Platform::Clamp(pos, 0, doc ? doc->Length() : pos);
+    int id = static_cast<int>(nodes.size());
+    if (!freeNodes.empty())
+      id = freeNodes.back(), freeNodes.pop_back();
+    else
+      nodes.push_back(Node());
+    seed ^= seed << 13, seed ^= seed >> 17, seed ^= seed << 5;
+    Node node = {-1, -1, -1, seed, pos, false, 0, 0, rightGravity, true};
+    nodes[id] = node;
+    int l, r;
+    Split(roots[rightGravity], pos, false, l, r);
+    SetRoot(rightGravity, Merge(Merge(l, id), r));
+    return id;
+  }
+  /** Returns the current position of the given position ID, or -1. */
+  int Get(int id) { return Valid(id) ? (Resolve(id), nodes[id].pos) : -1; }
+  /** Stops tracking the position with the given ID. */
+  void Remove(int id) {
+    if (!Valid(id)) return;
+    Resolve(id), Push(id);
+    int t = Merge(nodes[id].left, nodes[id].right), parent = nodes[id].parent;
+    if (parent < 0)
+      SetRoot(nodes[id].rightGravity, t);
+    else if (nodes[parent].left == id)
+      SetLeft(parent, t);
+    else
+      SetRight(parent, t);
+    nodes[id].used = false, freeNodes.push_back(id);
+  }
+  /**
+   * Fills the given arrays with the IDs and current positions of up to n
+   * tracked positions in position order.
+   * @return number of positions filled in, or the number of tracked positions
+   *   if either array is NULL
+   */
+  int GetAll(int *ids, int *positions, int n) {
+    if (!ids || !positions)
+      return static_cast<int>(nodes.size() - freeNodes.size());
+    std::vector<std::pair<int, int> > left, right;
+    Collect(roots[0], left), Collect(roots[1], right);
+    std::vector<std::pair<int, int> > all(left.size() + right.size());
+    std::merge(left.begin(), left.end(), right.begin(), right.end(),
+               all.begin());
+    int count = Platform::Minimum(n, static_cast<int>(all.size()));
+    for (int i = 0; i < count; i++)
+      ids[i] = all[i].second, positions[i] = all[i].first;
+    return count;
+  }
+};
+
+/** The number of bytes read or written at a time when streaming text. */
+#define STREAM_CHUNK_SIZE 65536
+
+#define INDEX_SEGMENT_SIZE 128
+#define INDEX_UNITS 4
+
+/**
+ * An index of the UTF-16 code units, code points, and display columns that
+ * precede positions in a UTF-8 document.
+ * The document is divided into segments of about `INDEX_SEGMENT_SIZE` bytes
+ * that start on character boundaries, and the start of each segment is kept
+ * in every unit (`SCU_*`). Edits only remeasure the segments they touch, and
+ * conversions only measure text within a single segment.
+ * Display columns follow `SurfaceImpl::grapheme_width()`.
+ */
+class EncodingIndex : public DocumentWatcher {
+  Partitioning *starts[INDEX_UNITS]; // segment starts in each unit
+  std::string text; // scratch buffer for measuring text
+
+  /**
+   * Measures the character at the start of the given string and adds its
+   * length in each unit to the given counts.
+   * @return the character's length in bytes
+   */
+  static int Measure(const char *s, int len, int *counts) {
+    const unsigned char *us = reinterpret_cast<const unsigned char *>(s);
+    int utf8Class = UTF8Classify(us, len), bytes = 1;
+    if (!(utf8Class & UTF8MaskInvalid)) bytes = utf8Class & UTF8MaskWidth;
+    char ch[UTF8MaxBytes + 1] = "";
+    memcpy(ch, s, bytes);
+    counts[SCU_BYTES] += bytes, counts[SCU_UTF16] += (bytes == 4) ? 2 : 1;
+    counts[SCU_CODEPOINTS]++;
+    counts[SCU_COLUMNS] += SurfaceImpl::grapheme_width(ch);
+    return bytes;
+  }
+  /**
+   * Reads the given range of the document, which is no longer than a segment,
+   * into the scratch buffer.
+   */
+  const char *Read(int start, int end) {
+    text.resize(end - start + 1); // never empty
+    if (end > start) doc->GetCharRange(&text[0], start, end - start);
+    return text.c_str();
+  }
+  /**
+   * Replaces the index of the given range of segments with an index of the
+   * given range of text, shifting later segments by the size difference.
+   */
+  void Reindex(int first, int last, int start, int end) {
+    int counts[INDEX_UNITS];
+    for (int i = 0; i < INDEX_UNITS; i++)
+      counts[i] = starts[i]->PositionFromPartition(first);
+    for (int i = last; i > first; i--)
+      for (int j = 0; j < INDEX_UNITS; j++) starts[j]->RemovePartition(i);
+    char s[STREAM_CHUNK_SIZE + UTF8MaxBytes];
+    int pos = start, len = 0, segment = first, size = 0;
+    for (int i = 0; i < len || pos < end; ) {
+      if (len - i < UTF8MaxBytes && pos < end) {
+        // Carry over any partial character to the front of the next chunk.
+        memmove(s, s + i, len - i), len -= i, i = 0;
+        int n = Platform::Minimum(end - pos, STREAM_CHUNK_SIZE);
+        doc->GetCharRange(s + len, pos, n), pos += n, len += n;
+      }
+      if (size >= INDEX_SEGMENT_SIZE) {
+        segment++, size = 0;
+        for (int j = 0; j < INDEX_UNITS; j++)
+          starts[j]->InsertPartition(segment, counts[j]);
+      }
+      int bytes = Measure(s + i, len - i, counts);
+      i += bytes, size += bytes;
+    }
+    for (int i = 0; i < INDEX_UNITS; i++)
+      starts[i]->InsertText(segment, counts[i] -
+                                     starts[i]->PositionFromPartition(
+                                       segment + 1));
+  }
+  /** Returns the number of the given units preceding the given position. */
+  int UnitsFromPosition(int unit, int pos) {
+    int segment = starts[SCU_BYTES]->PartitionFromPosition(pos);
+    int start = starts[SCU_BYTES]->PositionFromPartition(segment);
+    int counts[INDEX_UNITS];
+    for (int i = 0; i < INDEX_UNITS; i++)
+      counts[i] = starts[i]->PositionFromPartition(segment);
+    const char *s = Read(start, pos);
+    for (int i = 0, len = pos - start; i < len; )
+      i += Measure(s + i, len - i, counts);
+    return counts[unit];
+  }
+  /**
+   * Returns the position of the character that contains the given number of
+   * the given units, or the end of the document if there are fewer units.
+   */
+  int PositionFromUnits(int unit, int units) {
+    int segment = starts[unit]->PartitionFromPosition(units);
+    int start = starts[SCU_BYTES]->PositionFromPartition(segment);
+    int end = starts[SCU_BYTES]->PositionFromPartition(segment + 1);
+    int counts[INDEX_UNITS];
+    for (int i = 0; i < INDEX_UNITS; i++)
+      counts[i] = starts[i]->PositionFromPartition(segment);
+    const char *s = Read(start, end);
+    for (int i = 0, len = end - start; i < len; ) {
+      int next[INDEX_UNITS];
+      memcpy(next, counts, sizeof(counts));
+      int bytes = Measure(s + i, len - i, next);
+      if (next[unit] > units) break;
+      memcpy(counts, next, sizeof(counts)), i += bytes;
+    }
+    return counts[SCU_BYTES];
+  }
+public:
+  /** Creates a new index of the given UTF-8 document. */
+  EncodingIndex(Document *doc_) : DocumentWatcher(doc_) {
+    for (int i = 0; i < INDEX_UNITS; i++) starts[i] = new Partitioning(8);
+    Reindex(0, 0, 0, doc->Length());
+  }
+  /** Deletes the index. */
+  ~EncodingIndex() {
+    for (int i = 0; i < INDEX_UNITS; i++) delete starts[i];
+  }
+
+  /** Remeasures the segments touched by insertions and deletions. */
+  void NotifyModified(Document *document, DocModification mh,
+                      void *userData) {
+    if (!(mh.modificationType & (SC_MOD_INSERTTEXT | SC_MOD_DELETETEXT)))
+      return;
+    bool inserted = mh.modificationType & SC_MOD_INSERTTEXT;
+    int first = starts[SCU_BYTES]->PartitionFromPosition(mh.position);
+    int last = starts[SCU_BYTES]->PartitionFromPosition(
+      mh.position + (inserted ? 0 : mh.length));
+    int start = starts[SCU_BYTES]->PositionFromPartition(first);
+    int end = starts[SCU_BYTES]->PositionFromPartition(last + 1);
+    Reindex(first, last, start, end + (inserted ? mh.length : -mh.length));
+  }
+  /**
+   * Converts the given positions into lines and the given units from the
+   * start of those lines.
+   * @return number of positions converted
+   */
+  int GetUnits(int unit, const int *positions, int *lines, int *units, int n) {
+    if (!doc || unit < 0 || unit >= INDEX_UNITS) return 0;
+    for (int i = 0; i < n; i++) {
+      int pos = Platform::Clamp(positions[i], 0, doc->Length());
+      int line = doc->LineFromPosition(pos);
+      if (lines) lines[i] = line;
+      units[i] = UnitsFromPosition(unit, pos) -
+                 UnitsFromPosition(unit, doc->LineStart(line));
+    }
+    return n;
+  }
+  /**
+   * Converts the given lines and units from the start of those lines into
+   * positions.
+   * Units past the end of a line convert to the end of that line.
+   * @return number of positions converted
+   */
+  int GetPositions(int unit, const int *lines, const int *units, int *positions,
+                   int n) {
+    if (!doc || unit < 0 || unit >= INDEX_UNITS) return 0;
+    for (int i = 0; i < n; i++) {
+      int line = Platform::Clamp(lines[i], 0, doc->LinesTotal() - 1);
+      int start = UnitsFromPosition(unit, doc->LineStart(line));
+      positions[i] = Platform::Minimum(
+        PositionFromUnits(unit, start + Platform::Maximum(units[i], 0)),
+        doc->LineEnd(line));
+    }
+    return n;
+  }
+};
+
+/**
+ * An index of a document's fold header lines for finding the fold parents of
+ * lines without scanning backwards line by line.
+ * Headers are kept in a treap ordered by line, with each subtree's minimum
+ * fold level, so the nearest header above a line with a lower fold level is
+ * found in logarithmic time. Lines inserted or deleted shift later headers
+ * with a lazily propagated offset.
+ */
+class FoldParentIndex : public DocumentWatcher {
+  /** A fold header line and its treap links. */
+  struct Node {
+    int left, right; // node indices, or -1
+    unsigned int priority;
+    int line; // line number, valid once the ancestors' offsets are pushed
+    int level, minLevel; // the header's fold level and its subtree's minimum
+    int add; // pending line offset for all descendants
+  };
+  std::vector<Node> nodes;
+  std::vector<int> freeNodes; // indices of removed nodes available for reuse
+  int root;
+  unsigned int seed; // for treap priorities
+
+  /** Shifts the given subtree's root and marks its descendants. */
+  void Apply(int t, int delta) {
+    if (t >= 0) nodes[t].line += delta, nodes[t].add += delta;
+  }
+  /** Applies the given node's pending offset to its children. */
+  void Push(int t) {
+    if (nodes[t].add)
+      Apply(nodes[t].left, nodes[t].add), Apply(nodes[t].right, nodes[t].add);
+    nodes[t].add = 0;
+  }
+  /** Recomputes the given node's subtree minimum fold level. */
+  void Update(int t) {
+    Node &node = nodes[t];
+    node.minLevel = node.level;
+    if (node.left >= 0)
+      node.minLevel = Platform::Minimum(node.minLevel,
+                                        nodes[node.left].minLevel);
+    if (node.right >= 0)
+      node.minLevel = Platform::Minimum(node.minLevel,
+                                        nodes[node.right].minLevel);
+  }
+  /** Splits the given subtree into headers before the given line and after. */
+  void Split(int t, int line, int &l, int &r) {
+    if (t < 0) {
+      l = r = -1;
+      return;
+    }
+    Push(t);
+    if (nodes[t].line < line)
+      Split(nodes[t].right, line, nodes[t].right, r), l = t;
+    else
+      Split(nodes[t].left, line, l, nodes[t].left), r = t;
+    Update(t);
+  }
+  /** Merges the given subtrees, all of whose lines are ordered. */
+  int Merge(int l, int r) {
+    if (l < 0 || r < 0) return (l >= 0) ? l : r;
+    if (nodes[l].priority > nodes[r].priority) {
+      Push(l), nodes[l].right = Merge(nodes[l].right, r), Update(l);
+      return l;
+    }
+    Push(r), nodes[r].left = Merge(l, nodes[r].left), Update(r);
+    return r;
+  }
+  /** Frees the nodes of the given subtree. */
+  void Free(int t) {
+    if (t < 0) return;
+    Free(nodes[t].left), Free(nodes[t].right), freeNodes.push_back(t);
+  }
+  /** Removes the headers in the given range of lines. */
+  void Remove(int first, int last) {
+    int l, m, r;
+    Split(root, first, l, m), Split(m, last, m, r);
+    Free(m), root = Merge(l, r);
+  }
+  /** Shifts the headers at or after the given line by the given delta. */
+  void Shift(int line, int delta) {
+    int l, r;
+    Split(root, line, l, r), Apply(r, delta), root = Merge(l, r);
+  }
+  /** Indexes the given line if it is a fold header. */
+  void Set(int line) {
+    Remove(line, line + 1);
+    int level = doc->GetLevel(line);
+    if (!(level & SC_FOLDLEVELHEADERFLAG)) return;
+    int t = static_cast<int>(nodes.size());
+    if (!freeNodes.empty())
+      t = freeNodes.back(), freeNodes.pop_back();
+    else
+      nodes.push_back(Node());
+    seed ^= seed << 13, seed ^= seed >> 17, seed ^= seed << 5;
+    level &= SC_FOLDLEVELNUMBERMASK;
+    Node node = {-1, -1, seed, line, level, level, 0};
+    nodes[t] = node;
+    int l, r;
+    Split(root, line, l, r), root = Merge(Merge(l, t), r);
+  }
+  /**
+   * Returns the node of the last header before the given line with a fold
+   * level lower than the given one, or -1.
+   */
+  int FindParent(int t, int line, int level) {
+    if (t < 0 || nodes[t].minLevel >= level) return -1;
+    Push(t);
+    if (nodes[t].line >= line) return FindParent(nodes[t].left, line, level);
+    int parent = FindParent(nodes[t].right, line, level);
+    if (parent >= 0) return parent;
+    if (nodes[t].level < level) return t;
+    return FindParent(nodes[t].left, line, level);
+  }
+public:
+  /** Creates a new index of the given document's fold headers. */
+  FoldParentIndex(Document *doc_) : DocumentWatcher(doc_), root(-1),
+    seed(2463534242u) {
+    for (int line = 0; line < doc->LinesTotal(); line++) Set(line);
+  }
+
+  /** Reindexes lines whose fold levels changed, and shifts lines. */
+  void NotifyModified(Document *document, DocModification mh,
+                      void *userData) {
+    if (mh.modificationType & SC_MOD_CHANGEFOLD)
+      Set(mh.line);
+    else if (mh.modificationType & (SC_MOD_INSERTTEXT | SC_MOD_DELETETEXT) &&
+             mh.linesAdded != 0) {
+      int line = doc->LineFromPosition(mh.position);
+      if (mh.linesAdded < 0) Remove(line + 1, line + 1 - mh.linesAdded);
+      Shift(line + 1 - Platform::Minimum(mh.linesAdded, 0), mh.linesAdded);
+      // New lines take the fold levels of existing ones until they are lexed.
+      int last = Platform::Minimum(line + Platform::Maximum(mh.linesAdded, 0) +
+                                   1, doc->LinesTotal() - 1);
+      for (; line <= last; line++) Set(line);
+    }
+  }
+  /**
+   * Fills the given array with the fold parents of the given line, innermost
+   * first.
+   * @return number of fold parents filled in, or the number of fold parents
+   *   if the array is NULL
+   */
+  int GetParents(int line, int *parents, int n) {
+    if (!doc || line < 0 || line >= doc->LinesTotal()) return 0;
+    int level = doc->GetLevel(line) & SC_FOLDLEVELNUMBERMASK, count = 0;
+    for (int t; (t = FindParent(root, line, level)) >= 0; count++) {
+      if (parents && count >= n) break;
+      if (parents) parents[count] = nodes[t].line;
+      line = nodes[t].line, level = nodes[t].level;
+    }
+    return count;
+  }
+};
+
+/**
+ * Keeps the text of large edits to a document in a temporary file instead of
+ * in the document's undo history.
+ * A spilled edit is made with undo collection off and recorded in the undo
+ * history as a container action with a negative token. When that action is
+ * undone or redone, the edit's old or new text is read back from the file and
+ * swapped in. Since the document cannot be modified while it is undoing or
+ * redoing, this happens afterwards in `Restore()`.
+ * There is one spill per document, and it is deleted along with its document.
+ */
+class UndoSpill : public DocumentWatcher {
+  /** A spilled edit and the offsets of its old and new text in the file. */
+  struct Edit {
+    int position;
+    long oldOffset;
+    int oldLength;
+    long newOffset;
+    int newLength;
+  };
+  FILE *file; // the spill file, created when first needed
+  long fileSize;
+  std::vector<Edit> edits; // indexed by -token - 1
+  std::vector<std::pair<int, bool> > pending; // edits to undo (true) or redo
+  std::vector<int> actions; // bytes of text kept by each action recorded
+  size_t done; // number of actions recorded that are not undone
+  long resident; // bytes of text kept in memory by the actions recorded
+  static std::map<Document *, UndoSpill *> spills;
+
+  UndoSpill(Document *doc_) : DocumentWatcher(doc_), file(0), fileSize(0),
+    done(0), resident(0) {}
+  /**
+   * Records an undo action that keeps the given number of bytes of text in
+   * memory, discarding the actions that were undone like Scintilla's undo
+   * history does.
+   */
+  void Record(int length) {
+    for (size_t i = done; i < actions.size(); i++) resident -= actions[i];
+    actions.resize(done), actions.push_back(length), done++;
+    resident += length;
+  }
+  /** Moves back or forward through the actions recorded. */
+  void Step(bool undo) {
+    if (undo && done > 0) done--;
+    else if (!undo && done < actions.size()) done++;
+  }
+  /**
+   * Writes the given range of the document, or the given text, to the end of
+   * the file.
+   * @return whether or not the write was successful
+   */
+  bool Write(int position, const char *text, int length) {
+    if (fseek(file, fileSize, SEEK_SET) != 0) return false;
+    char buffer[STREAM_CHUNK_SIZE];
+    for (int i = 0; i < length; i += STREAM_CHUNK_SIZE) {
+      int n = Platform::Minimum(length - i, STREAM_CHUNK_SIZE);
+      if (!text) doc->GetCharRange(buffer, position + i, n);
+      const char *data = text ? text + i : buffer;
+      if (fwrite(data, 1, n, file) != static_cast<size_t>(n)) return false;
+    }
+    return (fileSize += length, true);
+  }
+  /**
+   * Replaces the given range of the document with the given text from the
+   * file, without recording undo history.
+   */
+  void Replace(int position, int deleteLength, long offset, int length) {
+    bool collecting = doc->IsCollectingUndo();
+    doc->SetUndoCollection(false);
+    doc->DeleteChars(position, deleteLength);
+    char buffer[STREAM_CHUNK_SIZE];
+    if (fseek(file, offset, SEEK_SET) == 0)
+      for (int i = 0; i < length; i += STREAM_CHUNK_SIZE) {
+        int n = Platform::Minimum(length - i, STREAM_CHUNK_SIZE);
+        if (fread(buffer, 1, n, file) != static_cast<size_t>(n)) break;
+        doc->InsertString(position + i, buffer, n);
+      }
+    doc->SetUndoCollection(collecting);
+  }
+public:
+  /** Deletes the spill and its file. */
+  ~UndoSpill() { if (file) fclose(file); }
+  /** Returns the given document's spill, creating it if necessary. */
+  static UndoSpill *Get(Document *doc) {
+    UndoSpill *&spill = spills[doc];
+    if (!spill) spill = new UndoSpill(doc);
+    return spill;
+  }
+  /** Returns the given document's spill, or NULL if it does not have one. */
+  static UndoSpill *Find(Document *doc) {
+    std::map<Document *, UndoSpill *>::iterator it = spills.find(doc);
+    return (it != spills.end()) ? it->second : NULL;
+  }
+
+  /**
+   * Queues the undoing or redoing of spilled edits, and follows the text that
+   * edits recorded in the undo history keep in memory.
+   * Container actions other than spilled edits keep no text and are ignored.
+   */
+  void NotifyModified(Document *document, DocModification mh,
+                      void *userData) {
+    bool undo = (mh.modificationType & SC_PERFORMED_UNDO) != 0;
+    bool redo = (mh.modificationType & SC_PERFORMED_REDO) != 0;
+    if (mh.modificationType & SC_MOD_CONTAINER) {
+      if (mh.token >= 0 || -mh.token > static_cast<int>(edits.size())) return;
+      pending.push_back(std::make_pair(-mh.token - 1, undo));
+      Step(undo);
+    } else if (mh.modificationType & (SC_MOD_INSERTTEXT | SC_MOD_DELETETEXT)) {
+      if (undo || redo)
+        Step(undo);
+      else if (doc->IsCollectingUndo())
+        Record(mh.length);
+    }
+  }
+  /**
+   * Deletes the spill along with its document.
+   * The document does not touch its watchers again after notifying them.
+   */
+  void NotifyDeleted(Document *document, void *userData) {
+    spills.erase(document);
+    doc = 0;
+    delete this;
+  }
+  /**
+   * Writes the old text of the given range and the text that replaces it to
+   * the file.
+   * @return container action token for the edit, or 0 if the file could not be
+   *   written
+   */
+  int Save(int position, int length, const char *text, int textLength) {
+    if (!file && !(file = tmpfile())) return 0;
+    Edit edit = {position, fileSize, length, fileSize + length, textLength};
+    if (!Write(position, NULL, length) || !Write(0, text, textLength)) {
+      fileSize = edit.oldOffset; // discard the partial write
+      return 0;
+    }
+    edits.push_back(edit);
+    Record(0); // the edit's container action
+    return -static_cast<int>(edits.size());
+  }
+  /** Swaps in the text of spilled edits that were undone or redone. */
+  void Restore() {
+    for (size_t i = 0; i < pending.size(); i++) {
+      Edit &edit = edits[pending[i].first];
+      if (pending[i].second)
+        Replace(edit.position, edit.newLength, edit.oldOffset, edit.oldLength);
+      else
+        Replace(edit.position, edit.oldLength, edit.newOffset, edit.newLength);
+    }
+    pending.clear();
+  }
+  /** Discards all spilled edits after the undo history has been emptied. */
+  void Clear() {
+    if (file) fclose(file), file = 0;
+    fileSize = 0, done = 0, resident = 0;
+    edits.clear(), pending.clear(), actions.clear();
+  }
+  /**
+   * Returns the bytes of text kept in memory by the undo history, leaving out
+   * text recorded before the spill was created and Scintilla's own overhead.
+   */
+  long GetResident() { return resident; }
+  /** Returns the number of bytes of undo data spilled to the file. */
+  long GetSpilled() { return fileSize; }
+};
+
+std::map<Document *, UndoSpill *> UndoSpill::spills;
+
+#if !_WIN32
+/**
+ * Filters a range of a document through a shell command.
+ * The range is streamed from the document to the command's standard input
+ * while its standard output is collected, and both happen in small steps so
+ * the caller's event loop can keep running. When the command exits
+ * successfully, its output replaces the range as a single undo action. The
+ * document is read-only while the command runs so the range cannot change.
+ */
+class Filter : public DocumentWatcher {
+  pid_t pid; // the command's process, or -1
+  int in, out; // pipes to the command's stdin and from its stdout, or -1
+  int start, end; // the range being filtered
+  int position; // the next position in the range to write
+  std::string output; // the command's output so far
+  bool readOnly; // whether or not the document was read-only beforehand
+  int status; // SCF_RUNNING, SCF_DONE, or SCF_FAILED
+
+  /** Closes the given pipe, if it is open. */
+  static void Close(int &fd) {
+    if (fd >= 0) close(fd), fd = -1;
+  }
+  /** Makes the given pipe non-blocking and not inherited by commands. */
+  static void Detach(int fd) {
+    fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK);
+    fcntl(fd, F_SETFD, FD_CLOEXEC);
+  }
+  /** Writes the next chunk of the range to the command. */
+  void Write() {
+    char buffer[STREAM_CHUNK_SIZE];
+    int n = Platform::Minimum(end - position, STREAM_CHUNK_SIZE);
+    doc->GetCharRange(buffer, position, n);
+    struct sigaction ignore, old;
+    memset(&ignore, 0, sizeof(ignore));
+    ignore.sa_handler = SIG_IGN;
+    sigaction(SIGPIPE, &ignore, &old); // report closed pipes via errno instead
+    ssize_t written = write(in, buffer, n);
+    int error = errno;
+    sigaction(SIGPIPE, &old, NULL);
+    if (written > 0) position += written;
+    if (position >= end || (written < 0 && error != EAGAIN && error != EINTR))
+      Close(in); // done, or the command stopped reading
+  }
+  /** Reads the command's available output, closing the pipe at its end. */
+  void Read() {
+    char buffer[STREAM_CHUNK_SIZE];
+    ssize_t n;
+    while ((n = read(out, buffer, STREAM_CHUNK_SIZE)) > 0)
+      output.append(buffer, n);
+    if (n == 0 || (errno != EAGAIN && errno != EINTR)) Close(out);
+  }
+  /**
+   * Stops filtering, replacing the range with the command's output if
+   * successful.
+   */
+  int Finish(bool success) {
+    Close(in), Close(out);
+    if (doc) doc->SetReadOnly(readOnly);
+    if (success && doc) {
+      doc->BeginUndoAction();
+      doc->DeleteChars(start, end - start);
+      doc->InsertString(start, output.data(), output.length());
+      doc->EndUndoAction();
+    }
+    std::string().swap(output);
+    return status = success && doc ? SCF_DONE : SCF_FAILED;
+  }
+public:
+  /**
+   * Starts filtering the given range of the given document through the given
+   * shell command.
+   * If the document is read-only or the command cannot be started, filtering
+   * fails immediately.
+   */
+  Filter(Document *doc_, int start_, int end_, const char *command) :
+    DocumentWatcher(doc_), pid(-1), in(-1), out(-1), readOnly(false),
+    status(SCF_FAILED) {
+    start = Platform::Clamp(start_, 0, doc->Length());
+    end = Platform::Clamp(end_, start, doc->Length());
+    position = start;
+    int stdinPipe[2], stdoutPipe[2];
+    if (doc->IsReadOnly() || pipe(stdinPipe) != 0) return;
+    if (pipe(stdoutPipe) != 0) {
+      close(stdinPipe[0]), close(stdinPipe[1]);
+      return;
+    }
+    if ((pid = fork()) == 0) {
+      dup2(stdinPipe[0], STDIN_FILENO), dup2(stdoutPipe[1], STDOUT_FILENO);
+      int null = open("/dev/null", O_WRONLY);
+      if (null >= 0) dup2(null, STDERR_FILENO); // keep off the terminal
+      close(stdinPipe[0]), close(stdinPipe[1]);
+      close(stdoutPipe[0]), close(stdoutPipe[1]);
+      signal(SIGPIPE, SIG_DFL);
+      execl("/bin/sh", "sh", "-c", command, static_cast<char *>(NULL));
+      _exit(127);
+    }
+    close(stdinPipe[0]), close(stdoutPipe[1]);
+    in = stdinPipe[1], out = stdoutPipe[0];
+    if (pid < 0) {
+      Close(in), Close(out);
+      return;
+    }
+    Detach(in), Detach(out);
+    readOnly = doc->IsReadOnly(), doc->SetReadOnly(true);
+    status = SCF_RUNNING;
+  }
+  /** Cancels filtering if it is still running. */
+  ~Filter() { Cancel(); }
+
+  /**
+   * Writes and reads as much as possible without blocking for longer than the
+   * given timeout.
+   * @param timeout The number of milliseconds to wait for the command, or `-1`
+   *   to wait until it is ready.
+   * @return SCF_RUNNING, SCF_DONE, or SCF_FAILED
+   */
+  int Step(int timeout) {
+    if (status != SCF_RUNNING) return status;
+    if (!doc) return (Cancel(), status);
+    // The command may close its output before it stops reading input (e.g. if
+    // it redirects its output), so keep writing while either pipe is open.
+    if (in >= 0 || out >= 0) {
+      struct pollfd fds[2] = {{out, POLLIN, 0}, {in, POLLOUT, 0}};
+      int n = 2;
+      if (out < 0) fds[0] = fds[1], n = 1;
+      else if (in < 0) n = 1;
+      if (poll(fds, n, timeout) > 0)
+        for (int i = 0; i < n; i++)
+          if (fds[i].revents) (fds[i].events == POLLOUT) ? Write() : Read();
+    }
+    if (in >= 0 || out >= 0) return status; // more to write or read
+    // Wait for the command to exit. With no pipes left to poll, block until it
+    // does, or check every few milliseconds until the timeout.
+    int exitStatus, waited = 0;
+    pid_t result;
+    for (;;) {
+      result = waitpid(pid, &exitStatus, (timeout < 0) ? 0 : WNOHANG);
+      if (result != 0 || waited >= timeout) break;
+      int n = Platform::Minimum(timeout - waited, 10);
+      poll(NULL, 0, n), waited += n;
+    }
+    if (result < 0 && errno == EINTR) return status; // try again next step
+    if (result == 0) return status;
+    pid = -1;
+    return Finish(result > 0 && WIFEXITED(exitStatus) &&
+                  WEXITSTATUS(exitStatus) == 0);
+  }
+  /** Stops filtering and kills the command, leaving the range as it is. */
+  void Cancel() {
+    if (pid > 0) kill(pid, SIGKILL), waitpid(pid, NULL, 0), pid = -1;
+    if (status == SCF_RUNNING) Finish(false);
+  }
+  /**
+   * Fills in the number of bytes of the range written to the command and the
+   * number of bytes of output read from it so far.
+   */
+  void GetProgress(int *written, int *read) {
+    if (written) *written = position - start;
+    if (read) *read = output.length();
+  }
+};
+#endif
+
+// Searching.
+
+/** The number of tags (the whole match and groups 1-9) a regex search finds. */
+#define REGEX_TAGS 10
+
+/**
+ * A regular expression that is searched for in time linear in the length of
+ * the text searched.
+ * It understands the syntax of Scintilla's built-in `RESearch` engine except
+ * for backreferences, and finds the same leftmost matches, greedy or, with
+ * `*?` and `+?`, lazy. Rather than
+ * backtracking, every way the expression could match is followed at once, one
+ * character at a time, as a Thompson NFA with capture tags (a "Pike VM").
+ * The document is read a chunk at a time instead of a line at a time, so while
+ * `^`, `$`, `.`, and negated sets still stop at line ends like `RESearch`'s,
+ * `\n`, `\r`, and `\s` can match across lines.
+ */
+class LinearRegex {
+  /**
+   * Instruction kinds. `SET` consumes a character in `sets[x]`, `SPLIT`
+   * continues at `x` and, with lower priority, at `y`, `JUMP` continues at
+   * `x`, and `SAVE` records the current position in tag slot `x`.
+   */
+  enum Op { SET, SPLIT, JUMP, SAVE, BOL, EOL, WORDSTART, WORDEND, MATCH };
+  struct Inst {
+    Op op;
+    int x, y;
+    Inst(Op op_, int x_=0, int y_=0) : op(op_), x(x_), y(y_) {}
+  };
+  typedef std::vector<Inst> Program;
+  /** A point in the program paired with the tags it has recorded so far. */
+  struct Thread {
+    int pc;
+    int tags[2 * REGEX_TAGS];
+  };
+  /** Reads characters from a document range a chunk at a time. */
+  class Reader {
+    Document *doc;
+    int end, chunkStart, chunkEnd;
+    char chunk[STREAM_CHUNK_SIZE];
+  public:
+    Reader(Document *doc_, int end_) : doc(doc_), end(end_), chunkStart(0),
+      chunkEnd(0) {}
+    /**
+     * Returns the character at the given position, or `-1` at or past the
+     * end.
+     */
+    int At(int position) {
+      if (position >= end) return -1;
+      if (position < chunkStart || position >= chunkEnd) {
+        int n = Platform::Minimum(end - position, STREAM_CHUNK_SIZE);
+        doc->GetCharRange(chunk, position, n);
+        chunkStart = position, chunkEnd = position + n;
+      }
+      return static_cast<unsigned char>(chunk[position - chunkStart]);
+    }
+  };
+
+  std::vector<std::bitset<256> > sets;
+  Program program;
+  std::bitset<256> word; // the document's word characters
+  bool caseSensitive, posix;
+  int groups;
+  std::vector<int> marks; // the generation a program point was last added in
+  int generation;
+  int rangeStart, rangeEnd; // the range being searched
+
+  /** Adds the other case of each letter in the set unless matching case. */
+  void Fold(std::bitset<256> &set) {
+    if (!caseSensitive)
+      for (int c = 0; c < 128; c++)
+        if (set[c]) set[tolower(c)] = set[toupper(c)] = true;
+  }
+  /** Adds the given character set to `sets` and returns its index. */
+  int AddSet(std::bitset<256> set) {
+    return (Fold(set), sets.push_back(set), sets.size() - 1);
+  }
+  /** Appends the given program fragment to another, relocating its jumps. */
+  static void Append(Program &program, const Program &fragment) {
+    int offset = program.size();
+    for (size_t i = 0; i < fragment.size(); i++) {
+      Inst inst = fragment[i];
+      if (inst.op == SPLIT || inst.op == JUMP) inst.x += offset;
+      if (inst.op == SPLIT) inst.y += offset;
+      program.push_back(inst);
+    }
+  }
+  /** Fills in the set of characters the escape after a '\\' stands for. */
+  void Escape(const std::string &re, size_t &p, std::bitset<256> &set) {
+    static const char *controls = "a\ab\bf\fn\nr\rt\tv\v";
+    char c = re[p++];
+    if (const char *control = (c != '\0') ? strchr(controls, c) : NULL)
+      if ((control - controls) % 2 == 0) return (void)set.set(control[1]);
+    switch (c) {
+      case 'd': case 'D': case 's': case 'S': case 'w': case 'W':
+        for (int ch = 0; ch < 256; ch++)
+          if ((tolower(c) == 'd') ? ch < 128 && isdigit(ch) :
+              (tolower(c) == 's') ? ch < 128 && isspace(ch) : word[ch])
+            set.set(ch);
+        if (isupper(c)) set.flip(), set.reset('\r'), set.reset('\n');
+        return;
+      case 'x': {
+        int value = 0, digits = 0;
+        for (; digits < 2 && p < re.length() && isxdigit(re[p]); digits++, p++)
+          value = value * 16 + (isdigit(re[p]) ? re[p] - '0' :
+                                tolower(re[p]) - 'a' + 10);
+        return (void)set.set(digits > 0 ? value : 'x');
+      }
+      default: set.set(static_cast<unsigned char>(c));
+    }
+  }
+  /** Parses a bracketed character set after its '['. */
+  bool ParseSet(const std::string &re, size_t &p, std::bitset<256> &set) {
+    bool negate = p < re.length() && re[p] == '^';
+    if (negate) p++;
+    for (size_t first = p; p < re.length() && (re[p] != ']' || p == first);) {
+      int from = static_cast<unsigned char>(re[p++]);
+      if (from == '\\' && p < re.length()) {
+        std::bitset<256> escaped;
+        Escape(re, p, escaped), set |= escaped;
+        continue;
+      }
+      int to = from;
+      if (p + 1 < re.length() && re[p] == '-' && re[p + 1] != ']')
+        to = static_cast<unsigned char>(re[p + 1]), p += 2;
+      for (int c = from; c <= to; c++) set.set(c);
+    }
+    if (p++ >= re.length()) return false; // unmatched '['
+    if (negate) Fold(set), set.flip(), set.reset('\r'), set.reset('\n');
+    return true;
+  }
+  /**
+   * Parses a sequence of atoms up to the end of a group or of the expression
+   * into a program fragment.
+   */
+  bool ParseSequence(const std::string &re, size_t &p, int depth,
+                     Program &fragment) {
+    const char *close = posix ? ")" : "\\)";
+    while (p < re.length()) {
+      if (re.compare(p, strlen(close), close) == 0) return depth > 0;
+      Program atom;
+      std::bitset<256> set;
+      char c = re[p++];
+      if (c == '^' && p == 1)
+        atom.push_back(Inst(BOL));
+      else if (c == '$' && p == re.length())
+        atom.push_back(Inst(EOL));
+      else if (c == '.')
+        set.set(), set.reset('\r'), set.reset('\n');
+      else if (c == '[') {
+        if (!ParseSet(re, p, set)) return false;
+      } else if (c == '\\' && p < re.length() && re[p] == '<')
+        p++, atom.push_back(Inst(WORDSTART));
+      else if (c == '\\' && p < re.length() && re[p] == '>')
+        p++, atom.push_back(Inst(WORDEND));
+      else if ((posix && c == '(') ||
+               (!posix && c == '\\' && p < re.length() && re[p] == '(')) {
+        if (!posix) p++;
+        int group = (++groups < REGEX_TAGS) ? groups : 0;
+        Program inner;
+        if (!ParseSequence(re, p, depth + 1, inner)) return false;
+        p += strlen(close);
+        if (group > 0) atom.push_back(Inst(SAVE, 2 * group));
+        Append(atom, inner);
+        if (group > 0) atom.push_back(Inst(SAVE, 2 * group + 1));
+      } else if (c == '\\') {
+        if (p >= re.length()) return false; // trailing '\\'
+        Escape(re, p, set);
+      } else
+        set.set(static_cast<unsigned char>(c));
+      if (atom.empty()) atom.push_back(Inst(SET, AddSet(set)));
+      // Repeat the atom. Like in `RESearch`, a '?' right after '*' or '+'
+      // makes it lazy, preferring fewer repetitions over more, and any more
+      // repetition operators after those are ignored.
+      for (bool closed = false;
+           p < re.length() && re[p] != '\0' && strchr("*+?", re[p]); p++) {
+        if (closed) continue;
+        Program repeated;
+        int n = atom.size();
+        bool lazy = re[p] != '?' && p + 1 < re.length() && re[p + 1] == '?';
+        if (re[p] == '*')
+          repeated.push_back(lazy ? Inst(SPLIT, n + 2, 1) :
+                                    Inst(SPLIT, 1, n + 2)),
+          Append(repeated, atom), repeated.push_back(Inst(JUMP, 0));
+        else if (re[p] == '+')
+          Append(repeated, atom),
+          repeated.push_back(lazy ? Inst(SPLIT, n + 1, 0) :
+                                    Inst(SPLIT, 0, n + 1));
+        else
+          repeated.push_back(Inst(SPLIT, 1, n + 1)), Append(repeated, atom);
+        atom.swap(repeated), closed = re[p] != '?';
+      }
+      Append(fragment, atom);
+    }
+    return depth == 0; // unmatched '(' otherwise
+  }
+  /**
+   * Adds the thread at the given program point to the given list, following
+   * jumps, splits, tags, and assertions at the given position first.
+   * `prev` and `cur` are the characters before and at that position.
+   */
+  void AddThread(std::vector<Thread> &list, int pc, int *tags, int position,
+                 int prev, int cur) {
+    if (marks[pc] == generation) return;
+    marks[pc] = generation;
+    const Inst &inst = program[pc];
+    switch (inst.op) {
+      case SPLIT:
+        AddThread(list, inst.x, tags, position, prev, cur);
+        AddThread(list, inst.y, tags, position, prev, cur);
+        return;
+      case JUMP: AddThread(list, inst.x, tags, position, prev, cur); return;
+      case SAVE: {
+        int saved = tags[inst.x];
+        tags[inst.x] = position;
+        AddThread(list, pc + 1, tags, position, prev, cur);
+        tags[inst.x] = saved;
+        return;
+      }
+      case BOL:
+        if (prev < 0 || prev == '\n' || (prev == '\r' && cur != '\n'))
+          AddThread(list, pc + 1, tags, position, prev, cur);
+        return;
+      case EOL:
+        if (cur < 0 || cur == '\r' || (cur == '\n' && prev != '\r'))
+          AddThread(list, pc + 1, tags, position, prev, cur);
+        return;
+      case WORDSTART: case WORDEND: {
+        // Like in `RESearch`, the edges of the range are word boundaries.
+        bool wordBefore = position > rangeStart && prev >= 0 && word[prev];
+        bool wordAfter = position < rangeEnd && cur >= 0 && word[cur];
+        if (wordBefore == (inst.op == WORDEND) && wordAfter != wordBefore)
+          AddThread(list, pc + 1, tags, position, prev, cur);
+        return;
+      }
+      default: {
+        Thread thread;
+        thread.pc = pc;
+        std::copy(tags, tags + 2 * REGEX_TAGS, thread.tags);
+        list.push_back(thread);
+      }
+    }
+  }
+
+  /**
+   * Searches from the given position to the end of the range for the compiled
+   * expression, finding the match that starts first, or last if `backward` is
+   * `true`, and returns whether or not it matched.
+   */
+  bool Scan(Document *doc, int start, bool backward, int *tags) {
+    int end = rangeEnd;
+    Reader text(doc, doc->Length());
+    std::vector<Thread> current, next;
+    int none[2 * REGEX_TAGS];
+    std::fill(none, none + 2 * REGEX_TAGS, -1);
+    marks.assign(program.size(), -1), generation = 0;
+    bool matched = false;
+    int prev = -1, cur = text.At(start);
+    if (start > 0) prev = static_cast<unsigned char>(doc->CharAt(start - 1));
+    AddThread(current, 0, none, start, prev, cur);
+    for (int i = start; ; i++) {
+      // Characters at or past the end are only looked at by assertions.
+      int following = (i < end) ? text.At(i + 1) : -1;
+      generation++, next.clear();
+      // When searching backwards, later starts take priority over earlier
+      // ones, so they are added first.
+      if (backward && i < end) AddThread(next, 0, none, i + 1, cur, following);
+      for (size_t j = 0; j < current.size(); j++) {
+        const Inst &inst = program[current[j].pc];
+        if (inst.op == MATCH) {
+          matched = true;
+          std::copy(current[j].tags, current[j].tags + 2 * REGEX_TAGS, tags);
+          break; // lower priority threads can only find less preferred matches
+        }
+        if (i < end && sets[inst.x][cur])
+          AddThread(next, current[j].pc + 1, current[j].tags, i + 1, cur,
+                    following);
+      }
+      if (!backward && !matched && i < end)
+        AddThread(next, 0, none, i + 1, cur, following);
+      if (i >= end || (matched && next.empty())) break;
+      current.swap(next), cur = following;
+    }
+    return matched;
+  }
+
+public:
+  LinearRegex() : caseSensitive(true), posix(false), groups(0),
+    generation(0), rangeStart(0), rangeEnd(0) {}
+  /**
+   * Returns whether or not the given expression can be searched for in linear
+   * time with the same results as `RESearch`.
+   * Backreferences cannot be. Neither can a lazy `*?` or `+?` that ends the
+   * expression, which `RESearch` lets repeat as many times as possible.
+   */
+  static bool IsSupported(const std::string &re) {
+    for (size_t i = 0; i < re.length(); i++)
+      if (re[i] == '\\' && i + 1 < re.length()) {
+        if (re[++i] >= '1' && re[i] <= '9') return false;
+      } else if ((re[i] == '*' || re[i] == '+') && i + 2 == re.length() &&
+                 re[i + 1] == '?')
+        return false;
+    return true;
+  }
+  /**
+   * Compiles the given expression for searching the given document and
+   * returns whether or not it is valid.
+   * @param flags `SCFIND_MATCHCASE` and `SCFIND_POSIX` are used.
+   */
+  bool Compile(const std::string &re, int flags, Document *doc) {
+    caseSensitive = (flags & SCFIND_MATCHCASE) != 0;
+    posix = (flags & SCFIND_POSIX) != 0;
+    for (int c = 0; c < 256; c++)
+      word[c] = doc->WordCharClass(c) == CharClassify::ccWord;
+    sets.clear(), program.clear(), groups = 0;
+    Program body;
+    size_t p = 0;
+    if (!ParseSequence(re, p, 0, body)) return false;
+    program.push_back(Inst(SAVE, 0));
+    Append(program, body);
+    program.push_back(Inst(SAVE, 1)), program.push_back(Inst(MATCH));
+    return true;
+  }
+  /**
+   * Searches the given range of the given document for the compiled
+   * expression and returns whether or not it matched.
+   * Searching forwards finds the match that starts first, looking at every
+   * character no more than once per instruction of the program. Searching
+   * backwards finds the match that starts last, looking at whole lines before
+   * the end of the range and at least doubling how far back it looks until
+   * they have a match. Its cost is then proportional to the distance to the
+   * match rather than to the start of the range.
+   * Like `RESearch`, `^` and `$` look at the characters just outside the
+   * range, so `^` does not match at the start of a range that starts mid-line
+   * and `$` does not match at the end of a range that ends mid-line. `\<` and
+   * `\>` do not, and treat both edges of the range as word boundaries.
+   * @param tags Filled with the start and end positions of the match (tag 0)
+   *   and of its groups, or `-1` for groups that did not match.
+   */
+  bool Search(Document *doc, int start, int end, bool backward, int *tags) {
+    rangeStart = start, rangeEnd = end;
+    if (!backward) return Scan(doc, start, false, tags);
+    for (int from = doc->LineStart(doc->LineFromPosition(end)); ; ) {
+      from = Platform::Maximum(from, start);
+      if (Scan(doc, from, true, tags)) return true;
+      if (from <= start) return false;
+      int back = Platform::Maximum(from - Platform::Maximum(end - from, 1), 0);
+      from = doc->LineStart(doc->LineFromPosition(back));
+    }
+  }
+};
+
+/**
+ * Downsampled summary of a document line used for drawing the minimap.
+ * Stores the line's indentation and width in characters along with its
+ * dominant (most frequent non-whitespace) style.
+ */
+struct MinimapLine {
+  unsigned short indent, width;
+  unsigned char style;
+  MinimapLine(int indent_=0, int width_=0, int style_=0) : indent(indent_),
+    width(width_), style(style_) {}
+};
+
+/**
+ * The minimap's line summaries.
+ * Lines are kept in a treap ordered by line number, and each node also holds
+ * the combined summary of its subtree. Looking up the summary of any block of
+ * lines takes logarithmic time, as do inserting and deleting lines.
+ */
+class MinimapSummary {
+  /** A line's summary and its treap links. */
+  struct Node {
+    int left, right; // node indices, or -1
+    unsigned int priority;
+    int size; // the number of lines in the subtree
+    MinimapLine line, block; // the line's summary and its subtree's
+  };
+  std::vector<Node> nodes;
+  std::vector<int> freeNodes; // indices of removed nodes available for reuse
+  int root;
+  unsigned int seed; // for treap priorities
+
+  /**
+   * Combines the summaries of two consecutive blocks of lines: the minimum
+   * indentation and the maximum width of their non-blank lines, along with
+   * the style of the first widest line.
+   */
+  static MinimapLine Combine(const MinimapLine &a, const MinimapLine &b) {
+    if (b.width <= b.indent) return a; // blank
+    if (a.width <= a.indent) return b;
+    const MinimapLine &widest = (b.width > a.width) ? b : a;
+    return MinimapLine(Platform::Minimum(a.indent, b.indent), widest.width,
+                       widest.style);
+  }
+  int Size(int t) { return (t >= 0) ? nodes[t].size : 0; }
+  /** Recomputes the given node's subtree size and summary. */
+  void Update(int t) {
+    Node &node = nodes[t];
+    node.size = 1 + Size(node.left) + Size(node.right), node.block = node.line;
+    if (node.left >= 0)
+      node.block = Combine(nodes[node.left].block, node.block);
+    if (node.right >= 0)
+      node.block = Combine(node.block, nodes[node.right].block);
+  }
+  /** Splits the given subtree into its first `n` lines and the rest. */
+  void Split(int t, int n, int &l, int &r) {
+    if (t < 0) {
+      l = r = -1;
+      return;
+    }
+    if (Size(nodes[t].left) < n)
+      Split(nodes[t].right, n - Size(nodes[t].left) - 1, nodes[t].right, r),
+      l = t;
+    else
+      Split(nodes[t].left, n, l, nodes[t].left), r = t;
+    Update(t);
+  }
+  /** Merges the given subtrees, the first's lines coming first. */
+  int Merge(int l, int r) {
+    if (l < 0 || r < 0) return (l >= 0) ? l : r;
+    if (nodes[l].priority > nodes[r].priority) {
+      nodes[l].right = Merge(nodes[l].right, r), Update(l);
+      return l;
+    }
+    nodes[r].left = Merge(l, nodes[r].left), Update(r);
+    return r;
+  }
+  /** Frees the nodes of the given subtree. */
+  void Free(int t) {
+    if (t < 0) return;
+    Free(nodes[t].left), Free(nodes[t].right), freeNodes.push_back(t);
+  }
+  /** Sets the summary of the given line of the given subtree. */
+  void Set(int t, int line, const MinimapLine &summary) {
+    int left = Size(nodes[t].left);
+    if (line < left)
+      Set(nodes[t].left, line, summary);
+    else if (line > left)
+      Set(nodes[t].right, line - left - 1, summary);
+    else
+      nodes[t].line = summary;
+    Update(t);
+  }
+  /** Returns the summary of the given range of lines of the given subtree. */
+  MinimapLine Get(int t, int start, int end) {
+    if (t < 0 || start >= end || end <= 0 || start >= nodes[t].size)
+      return MinimapLine();
+    if (start <= 0 && end >= nodes[t].size) return nodes[t].block;
+    int left = Size(nodes[t].left);
+    MinimapLine summary = Get(nodes[t].left, start, end);
+    if (start <= left && left < end)
+      summary = Combine(summary, nodes[t].line);
+    return Combine(summary, Get(nodes[t].right, start - left - 1,
+                                end - left - 1));
+  }
+public:
+  MinimapSummary() : root(-1), seed(2463534242u) {}
+
+  /** Returns the number of lines summarized. */
+  int Length() { return Size(root); }
+  /** Removes all lines. */
+  void DeleteAll() { nodes.clear(), freeNodes.clear(), root = -1; }
+  /** Inserts the given number of blank lines before the given line. */
+  void Insert(int line, int count) {
+    int lines = -1;
+    for (int i = 0; i < count; i++) {
+      int t = static_cast<int>(nodes.size());
+      if (!freeNodes.empty())
+        t = freeNodes.back(), freeNodes.pop_back();
+      else
+        nodes.push_back(Node());
+      seed ^= seed << 13, seed ^= seed >> 17, seed ^= seed << 5;
+      Node node = {-1, -1, seed, 1, MinimapLine(), MinimapLine()};
+      nodes[t] = node, lines = Merge(lines, t);
+    }
+    int l, r;
+    Split(root, line, l, r), root = Merge(Merge(l, lines), r);
+  }
+  /** Deletes the given number of lines starting at the given line. */
+  void Delete(int line, int count) {
+    int l, m, r;
+    Split(root, line, l, m), Split(m, count, m, r);
+    Free(m), root = Merge(l, r);
+  }
+  /** Sets the summary of the given line. */
+  void SetValueAt(int line, const MinimapLine &summary) {
+    if (line >= 0 && line < Length()) Set(root, line, summary);
+  }
+  /** Returns the combined summary of the lines in the given range. */
+  MinimapLine Summarize(int start, int end) { return Get(root, start, end); }
+};
+
+/** The number of document columns each horizontal minimap dot represents. */
+#define MINIMAP_DOT_COLUMNS 4
+
+/**
+ * A screen row of cells saved by the row cache, along with what the row shows.
+ * The row can be reused as long as its line's stamp is unchanged and the view
+ * is scrolled to the same horizontal offset.
+ */
+struct CachedRow {
+  int line, subline; // the document line and wrapped sub-line shown
+  unsigned long stamp; // the line's stamp when the row was painted
+  int xOffset; // the view's horizontal scroll offset
+  std::vector<NCURSES_CH_T> cells;
+};
+
 /** Implementation of Scintilla for the Terminal. */
 class ScintillaTerm : public ScintillaBase {
   Surface *sur; // window surface to draw on
@@ -943,6 +2431,25 @@ class ScintillaTerm : public ScintillaBase {
   unsigned int autoCompleteLastClickTime; // last click time in the AC box
   bool draggingVScrollBar, draggingHScrollBar; // a scrollbar is being dragged
   int dragOffset; // the distance to the position of the scrollbar being dragged
+  int marginRight; // right margin width requested via SCI_SETMARGINRIGHT
+  int minimapWidth; // width of the minimap, or 0 if it is hidden
+  int minimapLines; // number of document lines summarized by each dot row
+  int minimapFirstRow; // first dot row drawn in the minimap
+  MinimapSummary minimapSummary; // per-line minimap summaries
+  size_t rowCacheBudget; // maximum bytes of cached rows, or 0 to disable
+  size_t rowCacheSize; // bytes of cached rows
+  std::list<CachedRow> rowCache; // cached rows, most recently used first
+  std::map<std::pair<int, int>, std::list<CachedRow>::iterator> rowCacheIndex;
+  SplitVector<unsigned long> lineStamps; // per-line content and style stamps
+  unsigned long lastLineStamp; // the most recently assigned line stamp
+  int undoSpillThreshold; // edit size to spill undo data at, or 0 to disable
+  long undoSpillCap; // resident undo data size to spill at, or 0 for no cap
+  int undoDepth; // nesting depth of SCI_BEGINUNDOACTION
+  int stickyLines; // maximum number of sticky header rows, or 0 to hide it
+  std::vector<int> stickyHeader; // the fold parents shown in the header
+  FoldParentIndex *foldParents; // created when first needed
+  int searchTags[2 * REGEX_TAGS]; // the tags of the last linear regex search
+  bool searchedLinearly; // whether or not the last regex search was linear
 
   /**
    * Uses the given UTF-8 code point to fill the given UTF-8 byte sequence and
@@ -969,6 +2476,517 @@ class ScintillaTerm : public ScintillaBase {
     else if (*len == 5) s[0] = 0xF8 | (code & 0x03);
     else if (*len == 6) s[0] = 0xFC | (code & 0x01);
   }
+
+  /**
+   * Summarizes the given document line for the minimap.
+   * Whitespace does not count towards a line's dominant style.
+   * @param line The document line to summarize.
+   */
+  void SummarizeMinimapLine(int line) {
+    int counts[256] = {0};
+    int indent = -1, width = 0, style = STYLE_DEFAULT, most = 0;
+    for (int pos = pdoc->LineStart(line); pos < pdoc->LineEnd(line); pos++) {
+      char ch = pdoc->CharAt(pos);
+      if (UTF8IsTrailByte(static_cast<unsigned char>(ch))) continue;
+      width++;
+      if (ch == ' ' || ch == '\t') continue;
+      if (indent < 0) indent = width - 1;
+      int s = static_cast<unsigned char>(pdoc->StyleAt(pos));
+      if (++counts[s] > most) most = counts[s], style = s;
+    }
+    width = Platform::Minimum(width, 0xFFFF);
+    minimapSummary.SetValueAt(line, MinimapLine(indent >= 0 ? indent : width,
+                                                width, style));
+  }
+  /**
+   * Updates the minimap's line summaries after the given document
+   * modification.
+   * If the summaries are out of sync with the document, they are discarded
+   * and rebuilt the next time the minimap is drawn.
+   */
+  void UpdateMinimap(const DocModification &mh) {
+    if (minimapSummary.Length() == 0) return; // rebuilt when drawn
+    int line = pdoc->LineFromPosition(mh.position), last = line;
+    if (mh.modificationType & (SC_MOD_INSERTTEXT | SC_MOD_DELETETEXT)) {
+      if (minimapSummary.Length() != pdoc->LinesTotal() - mh.linesAdded) {
+        minimapSummary.DeleteAll(); // out of sync
+        return;
+      }
+      if (mh.linesAdded > 0)
+        minimapSummary.Insert(line + 1, mh.linesAdded);
+      else if (mh.linesAdded < 0)
+        minimapSummary.Delete(line + 1, -mh.linesAdded);
+      if (mh.modificationType & SC_MOD_INSERTTEXT) last += mh.linesAdded;
+    } else if (mh.modificationType & SC_MOD_CHANGESTYLE)
+      last = pdoc->LineFromPosition(mh.position + mh.length);
+    else return;
+    for (; line <= last; line++) SummarizeMinimapLine(line);
+  }
+  /**
+   * Sets Scintilla's right margin to the width requested via
+   * SCI_SETMARGINRIGHT plus the space the minimap needs, if any.
+   * When the vertical scroll bar is visible, the minimap is drawn to its left.
+   */
+  void UpdateRightMargin() {
+    int width = marginRight;
+    if (minimapWidth > 0)
+      width += minimapWidth + (verticalScrollBarVisible ? 1 : 0);
+    if (vs.rightMarginWidth != width)
+      vs.rightMarginWidth = width, InvalidateStyleRedraw();
+  }
+  /**
+   * Draws the minimap as a column of braille characters.
+   * Each character has 4 rows of 2 dots. A dot row summarizes `minimapLines`
+   * document lines and a dot represents `MINIMAP_DOT_COLUMNS` columns. The
+   * lines on the screen are highlighted. When the document has more dot rows
+   * than fit, the minimap scrolls proportionally with the view.
+   * Each dot row's summary is looked up in logarithmic time, so drawing is
+   * proportional to the minimap's height rather than to the document's length
+   * or `minimapLines`.
+   */
+  void DrawMinimap() {
+    if (minimapWidth <= 0) return;
+    WINDOW *w = GetWINDOW();
+    int maxy = getmaxy(w) - (horizontalScrollBarVisible ? 1 : 0);
+    int left = getmaxx(w) - minimapWidth - (verticalScrollBarVisible ? 1 : 0);
+    if (left < 0) return;
+    int lines = pdoc->LinesTotal();
+    if (minimapSummary.Length() != lines) {
+      minimapSummary.DeleteAll();
+      minimapSummary.Insert(0, lines);
+      for (int i = 0; i < lines; i++) SummarizeMinimapLine(i);
+    }
+    // Determine the first dot row to draw and the dot rows on the screen.
+    int rows = (lines + minimapLines - 1) / minimapLines, shown = maxy * 4;
+    int viewFirst = cs.DocFromDisplay(topLine) / minimapLines;
+    int viewLast = cs.DocFromDisplay(topLine + LinesOnScreen() - 1) /
+                   minimapLines;
+    minimapFirstRow = 0;
+    if (rows > shown) {
+      int maxFirst = Platform::Maximum(rows - (viewLast - viewFirst + 1), 1);
+      minimapFirstRow = static_cast<long long>(viewFirst) * (rows - shown) /
+                        maxFirst;
+      minimapFirstRow = Platform::Clamp(minimapFirstRow, 0, rows - shown);
+    }
+    static const int bits[4][2] = {
+      {0x01, 0x08}, {0x02, 0x10}, {0x04, 0x20}, {0x40, 0x80}
+    }; // braille dot bits for each dot row and column
+    ColourDesired back = vs.styles[STYLE_DEFAULT].back;
+    for (int y = 0; y < maxy; y++) {
+      // Aggregate the summaries of each of this row's dot rows.
+      int indents[4], widths[4], styles[4];
+      for (int i = 0; i < 4; i++) {
+        int row = minimapFirstRow + y * 4 + i;
+        int start = row * minimapLines;
+        int end = Platform::Minimum(start + minimapLines, lines);
+        MinimapLine summary = minimapSummary.Summarize(start, end);
+        indents[i] = summary.indent, styles[i] = summary.style;
+        widths[i] = (summary.width > summary.indent) ? summary.width : 0;
+      }
+      int firstRow = minimapFirstRow + y * 4;
+      bool inView = firstRow + 3 >= viewFirst && firstRow <= viewLast;
+      for (int x = 0; x < minimapWidth; x++) {
+        // Compute the braille dots and color of this character.
+        int dots = 0, style = -1;
+        for (int i = 0; i < 4; i++)
+          for (int j = 0; j < 2; j++) {
+            int column = (x * 2 + j) * MINIMAP_DOT_COLUMNS;
+            if (indents[i] >= column + MINIMAP_DOT_COLUMNS ||
+                widths[i] <= column) continue;
+            dots |= bits[i][j];
+            if (style < 0) style = styles[i];
+          }
+        if (style < 0 || style >= static_cast<int>(vs.styles.size()))
+          style = STYLE_DEFAULT;
+        wattr_set(w, 0, term_color_pair(vs.styles[style].fore,
+                                        inView ? LBLACK : back), NULL);
+        if (dots) {
+          char utf8[6];
+          int len;
+          toutf8(0x2800 | dots, utf8, &len);
+          mvwaddnstr(w, y, left + x, utf8, len);
+        } else mvwaddch(w, y, left + x, ' ');
+      }
+    }
+  }
+  /** Discards all cached rows. */
+  void ClearRowCache() {
+    rowCache.clear(), rowCacheIndex.clear(), rowCacheSize = 0;
+  }
+  /** Discards least recently used rows until the cache is within budget. */
+  void TrimRowCache() {
+    while (rowCacheSize > rowCacheBudget && !rowCache.empty()) {
+      CachedRow &row = rowCache.back();
+      rowCacheSize -= sizeof(CachedRow) +
+                      row.cells.size() * sizeof(NCURSES_CH_T);
+      rowCacheIndex.erase(std::make_pair(row.line, row.subline));
+      rowCache.pop_back();
+    }
+  }
+  /**
+   * Returns whether or not the given message leaves the rows already painted
+   * unchanged, apart from rows whose lines are stamped on modification and rows
+   * with the caret or selection on them.
+   * Any other message discards the row cache.
+   */
+  static bool PreservesRows(unsigned int iMessage) {
+    if (iMessage >= SCI_LINEDOWN && iMessage <= SCI_LINEENDDISPLAYEXTEND)
+      return iMessage != SCI_ZOOMIN && iMessage != SCI_ZOOMOUT; // key commands
+    switch (iMessage) {
+      // Queries.
+      case SCI_GETCURRENTPOS: case SCI_GETANCHOR: case SCI_GETLENGTH:
+      case SCI_GETTEXTLENGTH: case SCI_GETCHARAT: case SCI_GETSTYLEAT:
+      case SCI_GETLINE: case SCI_GETLINECOUNT: case SCI_GETSELTEXT:
+      case SCI_GETTEXT: case SCI_GETTEXTRANGE: case SCI_GETFIRSTVISIBLELINE:
+      case SCI_LINESONSCREEN: case SCI_GETCOLUMN: case SCI_GETLINEENDPOSITION:
+      case SCI_GETSELECTIONSTART: case SCI_GETSELECTIONEND:
+      case SCI_GETSELECTIONS: case SCI_GETSELECTIONEMPTY: case SCI_GETMODIFY:
+      case SCI_GETREADONLY: case SCI_CANUNDO: case SCI_CANREDO:
+      case SCI_GETLEXER: case SCI_GETLINESTATE: case SCI_GETFOLDLEVEL:
+      case SCI_GETFOLDPARENT: case SCI_GETLASTCHILD: case SCI_GETLINEVISIBLE:
+      case SCI_GETFOLDEXPANDED: case SCI_GETENDSTYLED: case SCI_GETTARGETSTART:
+      case SCI_GETTARGETEND: case SCI_GETCODEPAGE: case SCI_GETEOLMODE:
+      case SCI_GETCURLINE: case SCI_GETLINEINDENTATION:
+      case SCI_GETLINEINDENTPOSITION: case SCI_GETMARGINRIGHT:
+      case SCI_MARKERGET: case SCI_INDICATORVALUEAT: case SCI_INDICATORSTART:
+      case SCI_INDICATOREND: case SCI_AUTOCACTIVE: case SCI_CALLTIPACTIVE:
+      case SCI_GETSTATUS: case SCI_GETDOCPOINTER: case SCI_GETXOFFSET:
+      case SCI_GETTAG: case SCI_GETSEARCHFLAGS: case SCI_GETDIRECTFUNCTION:
+      case SCI_GETDIRECTPOINTER: case SCI_POSITIONFROMLINE:
+      case SCI_LINEFROMPOSITION: case SCI_POSITIONBEFORE:
+      case SCI_POSITIONAFTER: case SCI_WORDSTARTPOSITION:
+      case SCI_WORDENDPOSITION: case SCI_LINELENGTH: case SCI_BRACEMATCH:
+      case SCI_VISIBLEFROMDOCLINE: case SCI_DOCLINEFROMVISIBLE:
+      case SCI_WRAPCOUNT: case SCI_COUNTCHARACTERS: case SCI_FINDCOLUMN:
+      case SCI_TEXTWIDTH: case SCI_POINTXFROMPOSITION:
+      case SCI_POINTYFROMPOSITION: case SCI_POSITIONFROMPOINT:
+      case SCI_POSITIONFROMPOINTCLOSE:
+      // Caret, selection, scrolling, and searching.
+      case SCI_GOTOPOS: case SCI_GOTOLINE: case SCI_SETSEL:
+      case SCI_SETCURRENTPOS: case SCI_SETANCHOR: case SCI_SETSELECTIONSTART:
+      case SCI_SETSELECTIONEND: case SCI_SETEMPTYSELECTION: case SCI_SELECTALL:
+      case SCI_SETFIRSTVISIBLELINE: case SCI_LINESCROLL: case SCI_SCROLLCARET:
+      case SCI_SCROLLRANGE: case SCI_SETXOFFSET: case SCI_CHOOSECARETX:
+      case SCI_SEARCHANCHOR: case SCI_SEARCHNEXT: case SCI_SEARCHPREV:
+      case SCI_SETTARGETSTART: case SCI_SETTARGETEND:
+      case SCI_TARGETFROMSELECTION: case SCI_SETSEARCHFLAGS:
+      case SCI_SEARCHINTARGET: case SCI_FINDTEXT:
+      // Modifications, which stamp the lines they change.
+      case SCI_ADDTEXT: case SCI_INSERTTEXT: case SCI_APPENDTEXT:
+      case SCI_REPLACESEL: case SCI_REPLACETARGET: case SCI_REPLACETARGETRE:
+      case SCI_DELETERANGE: case SCI_CLEARALL: case SCI_SETTEXT: case SCI_UNDO:
+      case SCI_REDO: case SCI_CUT: case SCI_COPY: case SCI_PASTE:
+      case SCI_CLEAR:
+      case SCI_BEGINUNDOACTION: case SCI_ENDUNDOACTION:
+      case SCI_EMPTYUNDOBUFFER: case SCI_SETSAVEPOINT: case SCI_STARTSTYLING:
+      case SCI_SETSTYLING: case SCI_SETSTYLINGEX: case SCI_COLOURISE:
+      case SCI_SETINDICATORCURRENT: case SCI_SETINDICATORVALUE:
+      case SCI_INDICATORFILLRANGE: case SCI_INDICATORCLEARRANGE:
+      case SCI_MARKERADD: case SCI_MARKERDELETE: case SCI_SETLINESTATE:
+        return true;
+    }
+    return false;
+  }
+  /** Gives the given range of document lines new stamps. */
+  void StampLines(int first, int last) {
+    last = Platform::Minimum(last, lineStamps.Length() - 1);
+    for (int line = first; line <= last; line++)
+      lineStamps.SetValueAt(line, ++lastLineStamp);
+  }
+  /**
+   * Stamps the lines changed by the given document modification so cached rows
+   * showing them are no longer reused.
+   * If the stamps are out of sync with the document, they are discarded and
+   * rebuilt the next time the window is painted.
+   */
+  void UpdateRowCache(const DocModification &mh) {
+    if (lineStamps.Length() == 0) return; // rebuilt when painted
+    int line = pdoc->LineFromPosition(mh.position), last = line;
+    if (mh.modificationType & (SC_MOD_INSERTTEXT | SC_MOD_DELETETEXT)) {
+      if (lineStamps.Length() != pdoc->LinesTotal() - mh.linesAdded) {
+        lineStamps.DeleteAll(), ClearRowCache(); // out of sync
+        return;
+      }
+      if (mh.linesAdded > 0)
+        lineStamps.InsertValue(line + 1, mh.linesAdded, 0);
+      else if (mh.linesAdded < 0)
+        lineStamps.DeleteRange(line + 1, -mh.linesAdded);
+      last = line + Platform::Maximum(mh.linesAdded, 0);
+    } else if (mh.modificationType & SC_MOD_CHANGEFOLD) {
+      // Checked before SC_MOD_CHANGEMARKER, which Document::SetLevel() also
+      // sends.
+      ClearRowCache(); // fold margins depend on neighboring lines' levels
+      return;
+    } else if (mh.modificationType & (SC_MOD_CHANGESTYLE |
+                                      SC_MOD_CHANGEINDICATOR))
+      last = pdoc->LineFromPosition(mh.position + mh.length);
+    else if (mh.modificationType & (SC_MOD_CHANGEMARKER |
+                                    SC_MOD_CHANGEANNOTATION |
+                                    SC_MOD_CHANGEMARGIN)) {
+      if (mh.line < 0) {
+        ClearRowCache();
+        return;
+      }
+      line = last = mh.line;
+    } else return;
+    StampLines(line, last);
+  }
+  /** Returns whether or not the given line has the caret or selection on it. */
+  bool LineHasSelection(int line) {
+    for (size_t r = 0; r < sel.Count(); r++) {
+      int start = pdoc->LineFromPosition(sel.Range(r).Start().Position());
+      int end = pdoc->LineFromPosition(sel.Range(r).End().Position());
+      if (line >= start && line <= end) return true;
+    }
+    return false;
+  }
+  /**
+   * Draws the given rows' margin and text the way `Editor::Paint()` does, but
+   * without its preparation or its SCN_PAINTED notification.
+   * @see PaintWithRowCache
+   */
+  void PaintRows(int top, int bottom) {
+    PRectangle rcClient = GetClientRectangle(), rcMargin = rcClient;
+    PRectangle rcArea(0, top, rcClient.right, bottom);
+    rcMargin.right = vs.fixedColumnWidth;
+    sur->SetClip(rcArea);
+    if (vs.fixedColumnWidth > 0)
+      marginView.PaintMargin(sur, topLine, rcArea, rcMargin, *this, vs);
+    if (vs.rightMarginWidth > 0)
+      sur->FillRectangle(PRectangle(rcClient.right - vs.rightMarginWidth, top,
+                                    rcClient.right, bottom),
+                         vs.styles[STYLE_DEFAULT].back);
+    view.PaintText(sur, *this, rcArea, rcClient, vs);
+  }
+  /**
+   * Paints the window, copying rows that are unchanged since they were last
+   * painted from the row cache instead of laying out and drawing them again.
+   * Rows with the caret or selection on them are always painted, as are rows
+   * past the end of the document. Rows painted are then cached.
+   * The styling, wrapping, and SCN_UPDATEUI that `Editor::Paint()` does first
+   * are done once for the whole window, and SCN_PAINTED is sent once, no matter
+   * how many runs of rows are painted. If painting changes which lines are on
+   * the screen, the rows that were to be copied are painted instead.
+   */
+  void PaintWithRowCache() {
+    WINDOW *w = GetWINDOW();
+    if (rowCacheBudget == 0 || !wrowget(w, 0)) {
+      Paint(sur, rcPaint);
+      return;
+    }
+    // Style and wrap the lines on the screen first so the stamps of restyled
+    // lines change.
+    AllocateGraphics(), RefreshStyleData(), RefreshPixMaps(sur);
+    StyleToPositionInView(PositionAfterArea(rcPaint));
+    if (NotifyUpdateUI()) RefreshStyleData(), RefreshPixMaps(sur);
+    WrapLines(wsVisible);
+    if (lineStamps.Length() != pdoc->LinesTotal()) {
+      ClearRowCache(), lineStamps.DeleteAll();
+      lineStamps.InsertValue(0, pdoc->LinesTotal(), 0);
+      StampLines(0, pdoc->LinesTotal() - 1); // no two lines may share a stamp
+    }
+    // Determine the rows to copy from the cache.
+    int rows = rcPaint.bottom, cols = rcPaint.right;
+    std::vector<int> lines(rows), sublines(rows);
+    int count = GetVisibleLines(&lines[0], NULL, NULL, &sublines[0], rows);
+    std::vector<bool> cached(rows, false), painted(rows, false);
+    std::vector<std::list<CachedRow>::iterator> hits(rows);
+    for (int y = 0; y < count; y++) {
+      if (LineHasSelection(lines[y])) continue;
+      painted[y] = true;
+      std::map<std::pair<int, int>, std::list<CachedRow>::iterator>::iterator
+        it = rowCacheIndex.find(std::make_pair(lines[y], sublines[y]));
+      if (it == rowCacheIndex.end()) continue;
+      CachedRow &row = *it->second;
+      if (row.stamp != lineStamps.ValueAt(lines[y]) || row.xOffset != xOffset ||
+          static_cast<int>(row.cells.size()) != cols) continue;
+      cached[y] = true, painted[y] = false, hits[y] = it->second;
+    }
+    // Paint runs of rows that cannot be copied.
+    size_t cacheSize = rowCacheSize, cacheRows = rowCache.size();
+    for (int y = 0; y < rows; ) {
+      int end = y;
+      while (end < rows && !cached[end]) end++;
+      if (end > y) PaintRows(y, end);
+      y = end + 1;
+    }
+    NotifyPainted();
+    // Copy the cached rows, unless painting changed the lines on the screen,
+    // restamped them, or discarded the cache. In that case, paint those rows
+    // too, and leave the rows just painted uncached.
+    std::vector<int> lines2(rows), sublines2(rows);
+    bool changed = rowCacheSize != cacheSize || rowCache.size() != cacheRows ||
+                   GetVisibleLines(&lines2[0], NULL, NULL, &sublines2[0],
+                                   rows) != count ||
+                   lines != lines2 || sublines != sublines2;
+    for (int y = 0; y < count && !changed; y++)
+      changed = cached[y] && hits[y]->stamp != lineStamps.ValueAt(lines[y]);
+    if (changed) {
+      for (int y = 0; y < rows; y++)
+        if (cached[y]) PaintRows(y, y + 1);
+      return;
+    }
+    for (int y = 0; y < count; y++) {
+      if (!cached[y]) continue;
+      memcpy(wrowget(w, y), &hits[y]->cells[0], cols * sizeof(NCURSES_CH_T));
+      touchline(w, y, 1);
+      rowCache.splice(rowCache.begin(), rowCache, hits[y]);
+    }
+    // Cache the rows painted.
+    for (int y = 0; y < count; y++) {
+      if (!painted[y]) continue;
+      std::pair<int, int> key = std::make_pair(lines[y], sublines[y]);
+      std::map<std::pair<int, int>, std::list<CachedRow>::iterator>::iterator
+        it = rowCacheIndex.find(key);
+      if (it == rowCacheIndex.end()) {
+        rowCache.push_front(CachedRow());
+        it = rowCacheIndex.insert(std::make_pair(key, rowCache.begin())).first;
+        rowCacheSize += sizeof(CachedRow) + cols * sizeof(NCURSES_CH_T);
+      } else {
+        rowCache.splice(rowCache.begin(), rowCache, it->second);
+        rowCacheSize -= it->second->cells.size() * sizeof(NCURSES_CH_T);
+        rowCacheSize += cols * sizeof(NCURSES_CH_T);
+      }
+      CachedRow &row = *it->second;
+      row.line = lines[y], row.subline = sublines[y];
+      row.stamp = lineStamps.ValueAt(lines[y]), row.xOffset = xOffset;
+      row.cells.assign(wrowget(w, y), wrowget(w, y) + cols);
+    }
+    TrimRowCache();
+  }
+  /**
+   * Performs the given SCI_REPLACETARGET or SCI_SETTEXT message with its undo
+   * data spilled to disk if the edit is large enough, or if it would take the
+   * undo data kept in memory over its cap.
+   * Edits within an undo action are not spilled, since spilled edits can only
+   * be restored after undoing or redoing finishes. Other edits, like typing and
+   * pasting, are never spilled, but their text still counts towards the cap.
+   * Since the edit is made without undo collection, the document does not
+   * notify that its save point was left, so this is done here.
+   * @return whether or not the edit was performed
+   */
+  bool SpillEdit(unsigned int iMessage, uptr_t wParam, sptr_t lParam,
+                 sptr_t *result) {
+    const char *text = reinterpret_cast<const char *>(lParam);
+    if (undoSpillThreshold <= 0 || undoDepth > 0 || !pdoc->IsCollectingUndo() ||
+        !text)
+      return false;
+    int start = 0, end = pdoc->Length(), length = 0;
+    if (iMessage == SCI_REPLACETARGET)
+      start = targetStart, end = targetEnd,
+      length = (static_cast<int>(wParam) == -1) ? strlen(text) : wParam;
+    else
+      length = strlen(text);
+    UndoSpill *spill = UndoSpill::Get(pdoc);
+    long size = static_cast<long>(end - start) + length;
+    if (size < undoSpillThreshold &&
+        (undoSpillCap <= 0 || spill->GetResident() + size <= undoSpillCap))
+      return false;
+    int token = spill->Save(start, end - start, text, length);
+    if (!token) return false; // keep the undo data in memory instead
+    bool savePoint = pdoc->IsSavePoint();
+    pdoc->SetUndoCollection(false);
+    *result = ScintillaBase::WndProc(iMessage, wParam, lParam);
+    pdoc->SetUndoCollection(true);
+    pdoc->AddUndoAction(token, false);
+    if (savePoint && !pdoc->IsSavePoint()) NotifySavePoint(pdoc, NULL, false);
+    return true;
+  }
+  /**
+   * Searches the given range for the given regular expression with
+   * `LinearRegex` if the given search flags have both `SCFIND_REGEXP` and
+   * `SCFIND_LINEAR` and the expression has no backreferences.
+   * The range is searched backwards if `start` is greater than `end`.
+   * @param position Filled with the position of the match, or `-1`.
+   * @param length Filled with the length of the match.
+   * @return whether or not the search was performed
+   */
+  bool SearchLinear(const std::string &pattern, int flags, int start, int end,
+                    int *position, int *length) {
+    searchedLinearly = (flags & SCFIND_REGEXP) && (flags & SCFIND_LINEAR) &&
+                       !(flags & SCFIND_CXX11REGEX) &&
+                       LinearRegex::IsSupported(pattern);
+    if (!searchedLinearly) return false;
+    start = Platform::Clamp(start, 0, pdoc->Length());
+    end = Platform::Clamp(end, 0, pdoc->Length());
+    std::fill(searchTags, searchTags + 2 * REGEX_TAGS, -1);
+    LinearRegex regex;
+    if (regex.Compile(pattern, flags, pdoc) &&
+        regex.Search(pdoc, Platform::Minimum(start, end),
+                     Platform::Maximum(start, end), start > end, searchTags))
+      *position = searchTags[0], *length = searchTags[1] - searchTags[0];
+    else
+      *position = -1, *length = 0;
+    return true;
+  }
+  /** Returns the text of the given tag of the last linear regex search. */
+  std::string GetSearchTag(int tag) {
+    int start = searchTags[2 * tag], end = searchTags[2 * tag + 1];
+    if (start < 0 || end <= start || end > pdoc->Length()) return std::string();
+    std::string text(end - start, '\0');
+    return (pdoc->GetCharRange(&text[0], start, end - start), text);
+  }
+  /**
+   * Returns the given SCI_REPLACETARGETRE text with "\\0" to "\\9" replaced by
+   * the tags of the last linear regex search and other escapes replaced by the
+   * characters they stand for, just like `RESearch` does.
+   */
+  std::string SubstituteSearchTags(const char *text, int length) {
+    static const char *escapes = "a\ab\bf\fn\nr\rt\tv\v\\\\";
+    std::string result;
+    for (int i = 0; i < length; i++) {
+      if (text[i] != '\\' || i + 1 >= length) {
+        result += text[i];
+        continue;
+      }
+      char c = text[++i];
+      const char *escape = (c != '\0') ? strchr(escapes, c) : NULL;
+      if (c >= '0' && c <= '9')
+        result += GetSearchTag(c - '0');
+      else if (escape && (escape - escapes) % 2 == 0)
+        result += escape[1];
+      else
+        result += '\\', result += c;
+    }
+    return result;
+  }
+  /**
+   * Draws the fold parents of the first line below the sticky header over the
+   * top rows of the window, outermost first.
+   * Each header row's margin and text are drawn by Scintilla's margin and text
+   * views with the view temporarily scrolled so that the header's line is on
+   * that row. This bypasses `Editor::Paint()`, so the host gets no extra
+   * SCN_PAINTED notifications, and wrapping and scroll bars are not updated
+   * for the temporary scroll position.
+   */
+  void DrawStickyHeader() {
+    stickyHeader.clear();
+    int rows = Platform::Minimum(stickyLines, LinesOnScreen() - 1);
+    if (rows <= 0) return;
+    std::vector<int> parents(rows);
+    for (int pass = 0; pass < 2; pass++) {
+      // The header may cover the line whose parents it shows, so look again
+      // below it.
+      int line = cs.DocFromDisplay(topLine + stickyHeader.size());
+      int n = GetFoldParents(line, &parents[0], rows);
+      stickyHeader.assign(parents.rend() - n, parents.rend());
+    }
+    PRectangle rcClient = GetClientRectangle(), rcMargin = rcClient;
+    rcMargin.right = vs.fixedColumnWidth;
+    int top = topLine;
+    for (size_t i = 0; i < stickyHeader.size(); i++) {
+      topLine = cs.DisplayFromDoc(stickyHeader[i]) - i;
+      PRectangle rcRow(0, i, rcClient.right, i + 1);
+      if (vs.fixedColumnWidth > 0)
+        marginView.PaintMargin(sur, topLine, rcRow, rcMargin, *this, vs);
+      view.PaintText(sur, *this, rcRow, rcClient, vs);
+    }
+    topLine = top;
+  }
+  /** Swaps in the text of any spilled edits just undone or redone. */
+  void RestoreSpilledEdits() {
+    if (UndoSpill *spill = UndoSpill::Find(pdoc)) spill->Restore();
+  }
 public:
   /**
    * Creates a new Scintilla instance in a curses `WINDOW`.
@@ -977,7 +2995,12 @@ public:
    * @param callback_ Callback function for Scintilla notifications.
    */
   ScintillaTerm(void (*callback_)(Scintilla *, int, void *, void *)) :
-               width(0), height(0), scrollBarHeight(1), scrollBarWidth(1) {
+               width(0), height(0), scrollBarHeight(1), scrollBarWidth(1),
+               marginRight(0), minimapWidth(0), minimapLines(1),
+               minimapFirstRow(0), rowCacheBudget(0), rowCacheSize(0),
+               lastLineStamp(0), undoSpillThreshold(0), undoSpillCap(0),
+               undoDepth(0), stickyLines(0), foldParents(0),
+               searchedLinearly(false) {
     callback = callback_;
     sur = Surface::Allocate(SC_TECHNOLOGY_DEFAULT);
 
@@ -1029,6 +3052,7 @@ public:
   }
   /** Deletes the Scintilla instance. */
   ~ScintillaTerm() {
+    delete foldParents;
     if (wMain.GetID())
       delwin(GetWINDOW());
     if (sur) {
@@ -1109,6 +3133,17 @@ public:
   void ClaimSelection() {}
   /** Notifying the parent of text changes is not yet supported. */
   void NotifyChange() {}
+  /**
+   * Handles a document modification.
+   * In addition to Scintilla's handling, keeps the minimap's line summaries up
+   * to date.
+   */
+  void NotifyModified(Document *document, DocModification mh,
+                      void *userData) {
+    ScintillaBase::NotifyModified(document, mh, userData);
+    if (minimapWidth > 0) UpdateMinimap(mh);
+    if (rowCacheBudget > 0) UpdateRowCache(mh);
+  }
   /** Send Scintilla notifications to the parent. */
   void NotifyParent(SCNotification scn) {
     if (callback)
@@ -1187,6 +3222,7 @@ public:
    */
   sptr_t WndProc(unsigned int iMessage, uptr_t wParam, sptr_t lParam) {
     try {
+      if (!rowCache.empty() && !PreservesRows(iMessage)) ClearRowCache();
       switch (iMessage) {
         case SCI_GETDIRECTFUNCTION:
           return reinterpret_cast<sptr_t>(scintilla_send_message);
@@ -1197,6 +3233,91 @@ public:
         case SCI_SETTWOPHASEDRAW: case SCI_SETPHASESDRAW:
         case SCI_SETEXTRAASCENT: case SCI_SETEXTRADESCENT:
           return 0;
+        // Keep the minimap's space in the right margin.
+        case SCI_SETMARGINRIGHT:
+          marginRight = static_cast<int>(lParam);
+          return (UpdateRightMargin(), 0);
+        case SCI_GETMARGINRIGHT: return marginRight;
+        // Colors map to curses color pairs only when drawn and never affect
+        // character widths, so recoloring an existing style need not throw
+        // away line layouts like Scintilla's general style invalidation does.
+        case SCI_STYLESETFORE: case SCI_STYLESETBACK:
+          if (wParam >= vs.styles.size())
+            return ScintillaBase::WndProc(iMessage, wParam, lParam);
+          if (iMessage == SCI_STYLESETFORE)
+            vs.styles[wParam].fore = ColourDesired(static_cast<long>(lParam));
+          else
+            vs.styles[wParam].back = ColourDesired(static_cast<long>(lParam));
+          return (Redraw(), 0);
+        // Spill the undo data of large edits to disk.
+        case SCI_REPLACETARGET: case SCI_SETTEXT: {
+          sptr_t result = 0;
+          if (SpillEdit(iMessage, wParam, lParam, &result)) return result;
+          return ScintillaBase::WndProc(iMessage, wParam, lParam);
+        }
+        case SCI_UNDO: case SCI_REDO: {
+          sptr_t result = ScintillaBase::WndProc(iMessage, wParam, lParam);
+          return (RestoreSpilledEdits(), result);
+        }
+        case SCI_BEGINUNDOACTION: case SCI_ENDUNDOACTION:
+          undoDepth += (iMessage == SCI_BEGINUNDOACTION) ? 1 : -1;
+          undoDepth = Platform::Maximum(undoDepth, 0);
+          return ScintillaBase::WndProc(iMessage, wParam, lParam);
+        // Search with the linear time regex engine if asked to, and use its
+        // tags until the next regex search by Scintilla.
+        case SCI_SEARCHINTARGET: {
+          std::string pattern(reinterpret_cast<const char *>(lParam), wParam);
+          int position = 0, length = 0;
+          if (!SearchLinear(pattern, searchFlags, targetStart, targetEnd,
+                            &position, &length))
+            return ScintillaBase::WndProc(iMessage, wParam, lParam);
+          if (position < 0) return -1;
+          targetStart = position, targetEnd = position + length;
+          return position;
+        }
+        case SCI_FINDTEXT: {
+          Sci_TextToFind *ft = reinterpret_cast<Sci_TextToFind *>(lParam);
+          int position = 0, length = 0;
+          if (!SearchLinear(ft->lpstrText, wParam, ft->chrg.cpMin,
+                            ft->chrg.cpMax, &position, &length))
+            return ScintillaBase::WndProc(iMessage, wParam, lParam);
+          if (position < 0) return -1;
+          ft->chrgText.cpMin = position, ft->chrgText.cpMax = position + length;
+          return position;
+        }
+        case SCI_SEARCHNEXT: case SCI_SEARCHPREV:
+          searchedLinearly = false;
+          return ScintillaBase::WndProc(iMessage, wParam, lParam);
+        case SCI_GETTAG: {
+          if (!searchedLinearly)
+            return ScintillaBase::WndProc(iMessage, wParam, lParam);
+          std::string tag;
+          if (wParam >= 1 && wParam <= 9) tag = GetSearchTag(wParam);
+          if (lParam) memcpy(reinterpret_cast<char *>(lParam), tag.c_str(),
+                             tag.length() + 1);
+          return tag.length();
+        }
+        case SCI_REPLACETARGETRE: {
+          const char *text = reinterpret_cast<const char *>(lParam);
+          if (!searchedLinearly || !text)
+            return ScintillaBase::WndProc(iMessage, wParam, lParam);
+          int length = (static_cast<int>(wParam) == -1) ? strlen(text) : wParam;
+          std::string replacement = SubstituteSearchTags(text, length);
+          return WndProc(SCI_REPLACETARGET, replacement.length(),
+                         reinterpret_cast<sptr_t>(replacement.c_str()));
+        }
+        case SCI_EMPTYUNDOBUFFER:
+          if (UndoSpill *spill = UndoSpill::Find(pdoc)) spill->Clear();
+          return ScintillaBase::WndProc(iMessage, wParam, lParam);
+        case SCI_SETDOCPOINTER: {
+          undoDepth = 0;
+          minimapSummary.DeleteAll(); // rebuilt when drawn
+          lineStamps.DeleteAll(), ClearRowCache(); // rebuilt when painted
+          delete foldParents, foldParents = 0; // rebuilt when needed
+          sptr_t result = ScintillaBase::WndProc(iMessage, wParam, lParam);
+          if (undoSpillThreshold > 0) UndoSpill::Get(pdoc); // start accounting
+          return result;
+        }
         // Pass to Scintilla.
         default: return ScintillaBase::WndProc(iMessage, wParam, lParam);
       }
@@ -1240,7 +3361,10 @@ public:
     getmaxyx(w, rcPaint.bottom, rcPaint.right);
     if (rcPaint.bottom != height || rcPaint.right != width)
       height = rcPaint.bottom, width = rcPaint.right, ChangeSize();
-    Paint(sur, rcPaint);
+    UpdateRightMargin();
+    PaintWithRowCache();
+    DrawStickyHeader();
+    DrawMinimap();
     SetVerticalScrollPos(), SetHorizontalScrollPos();
     wnoutrefresh(w);
 #if PDCURSES
@@ -1278,6 +3402,7 @@ public:
    */
   void KeyPress(int key, bool shift, bool ctrl, bool alt) {
     KeyDown(key, shift, ctrl, alt, NULL);
+    RestoreSpilledEdits(); // in case the key was bound to undo or redo
   }
   /**
    * Handles a mouse button press.
@@ -1295,6 +3420,7 @@ public:
   bool MousePress(int button, unsigned int time, int y, int x, bool shift,
                   bool ctrl, bool alt) {
     GetWINDOW(); // ensure the curses `WINDOW` has been created
+    ClearRowCache(); // the mouse may change folds, hotspots, etc.
     if (ac.Active() && (button == 1 || button == 4 || button == 5)) {
       // Select an autocompletion list item if possible or scroll the list.
       WINDOW *w = _WINDOW(ac.lb->GetID()), *parent = GetWINDOW();
@@ -1362,7 +3488,16 @@ public:
           return (HorizontalScrollTo(xOffset + getmaxx(GetWINDOW()) / 2), true);
         else
           draggingHScrollBar = true, dragOffset = x - scrollBarHPos;
-      } else
+      } else if (minimapWidth > 0 &&
+                 x >= getmaxx(GetWINDOW()) - minimapWidth -
+                      (verticalScrollBarVisible ? 1 : 0)) {
+        // Scroll to the lines under the minimap click.
+        int line = (minimapFirstRow + y * 4) * minimapLines;
+        return (ScrollTo(cs.DisplayFromDoc(line) - LinesOnScreen() / 2), true);
+      } else if (y < static_cast<int>(stickyHeader.size()))
+        // Go to the sticky header line clicked on.
+        return (WndProc(SCI_GOTOLINE, stickyHeader[y], 0), true);
+      else
         // Have Scintilla handle the click.
         return (ButtonDown(Point(x, y), time, shift, ctrl, alt), true);
     } else if (button == 4 || button == 5) {
@@ -1388,6 +3523,7 @@ public:
    */
   bool MouseMove(int y, int x, bool shift, bool ctrl, bool alt) {
     GetWINDOW(); // ensure the curses `WINDOW` has been created
+    ClearRowCache(); // the mouse may change hotspots
     if (!draggingVScrollBar && !draggingHScrollBar) {
       int modifiers = (shift ? SCI_SHIFT : 0) | (ctrl ? SCI_CTRL : 0) |
                       (alt ? SCI_ALT : 0);
@@ -1414,6 +3550,7 @@ public:
    */
   void MouseRelease(int time, int y, int x, int ctrl) {
     GetWINDOW(); // ensure the curses `WINDOW` has been created
+    ClearRowCache(); // the mouse may change folds, hotspots, etc.
     if (draggingVScrollBar || draggingHScrollBar)
       draggingVScrollBar = false, draggingHScrollBar = false;
     else if (HaveMouseCapture())
@@ -1430,6 +3567,147 @@ public:
     if (buffer) memcpy(buffer, clipboard.Data(), clipboard.Length() + 1);
     return clipboard.Length() + 1;
   }
+  /**
+   * Fills the given arrays with the document line, start position, end
+   * position, and wrapped sub-line index of each display line on the screen,
+   * starting with the first visible line.
+   * Any of the arrays may be `NULL`.
+   * Wrapped lines are laid out in order to determine sub-line boundaries.
+   * Display lines used by annotations have empty ranges at their line's end.
+   * @param lines The array to fill with document lines.
+   * @param starts The array to fill with display line start positions.
+   * @param ends The array to fill with display line end positions.
+   * @param sublines The array to fill with wrapped sub-line indices.
+   * @param n The maximum number of display lines to fill in.
+   * @return number of display lines filled in
+   */
+  int GetVisibleLines(int *lines, int *starts, int *ends, int *sublines,
+                      int n) {
+    GetWINDOW(); // ensure the curses `WINDOW` has been created
+    AutoSurface surface(this);
+    int last = Platform::Minimum(topLine + LinesOnScreen(),
+                                 cs.LinesDisplayed());
+    int count = 0;
+    for (int visible = topLine; visible < last && count < n; visible++) {
+      int line = cs.DocFromDisplay(visible);
+      int subLine = visible - cs.DisplayFromDoc(line);
+      int start = pdoc->LineStart(line), end = pdoc->LineEnd(line);
+      if (cs.GetHeight(line) > 1 && surface) {
+        // Lay out the line in order to find its sub-line boundaries.
+        AutoLineLayout ll(view.llc, view.RetrieveLineLayout(line, *this));
+        if (ll) {
+          view.LayoutLine(*this, line, surface, vs, ll, wrapWidth);
+          if (subLine < ll->lines) {
+            if (subLine + 1 < ll->lines)
+              end = start + ll->LineStart(subLine + 1);
+            start += ll->LineStart(subLine);
+          } else start = end; // annotation
+        }
+      }
+      if (lines) lines[count] = line;
+      if (starts) starts[count] = start;
+      if (ends) ends[count] = end;
+      if (sublines) sublines[count] = subLine;
+      count++;
+    }
+    return count;
+  }
+  /**
+   * Fills the given arrays with the start position and style of each run of
+   * identically styled characters in the given range.
+   * A run ends where the next one starts, or at the end of the range.
+   * Call with `NULL` arrays first to get the number of runs in the range.
+   * @param start The start position of the range.
+   * @param end The end position of the range.
+   * @param positions The array to fill with run start positions.
+   * @param styles The array to fill with run styles.
+   * @param n The maximum number of runs to fill in.
+   * @return number of runs filled in, or the number of runs in the range if
+   *   either array is `NULL`
+   */
+  int GetStyleRuns(int start, int end, int *positions, int *styles, int n) {
+    bool counting = !positions || !styles;
+    start = Platform::Clamp(start, 0, pdoc->Length());
+    end = Platform::Clamp(end, start, pdoc->Length());
+    int count = 0, prevStyle = -1;
+    for (int pos = start; pos < end; pos++) {
+      int style = static_cast<unsigned char>(pdoc->StyleAt(pos));
+      if (style == prevStyle) continue;
+      if (!counting) {
+        if (count == n) break;
+        positions[count] = pos, styles[count] = style;
+      }
+      count++, prevStyle = style;
+    }
+    return count;
+  }
+  /**
+   * Shows or hides the minimap.
+   * The minimap is drawn in the right margin, to the left of the vertical
+   * scroll bar.
+   * @param width The width of the minimap, or `0` to hide it.
+   * @param lines The number of document lines each row of minimap dots
+   *   summarizes.
+   */
+  void SetMinimap(int width, int lines) {
+    minimapWidth = Platform::Maximum(width, 0);
+    minimapLines = Platform::Maximum(lines, 1);
+    minimapSummary.DeleteAll(); // rebuilt when drawn
+    UpdateRightMargin();
+  }
+  /**
+   * Sets the maximum number of bytes of painted rows to cache for reuse, or
+   * disables the row cache.
+   * @param size The maximum number of bytes to cache, or `0`.
+   */
+  void SetRowCache(int size) {
+    rowCacheBudget = Platform::Maximum(size, 0);
+    if (rowCacheBudget == 0) lineStamps.DeleteAll();
+    TrimRowCache();
+  }
+  /**
+   * Sets the edit size above which undo data is spilled to a temporary file,
+   * and the amount of undo data kept in memory above which edits are always
+   * spilled.
+   * @param threshold The edit size in bytes to spill at, or `0` to disable.
+   * @param cap The resident undo data size in bytes to spill at, or `0`.
+   */
+  void SetUndoSpill(int threshold, int cap) {
+    undoSpillThreshold = Platform::Maximum(threshold, 0);
+    undoSpillCap = Platform::Maximum(cap, 0);
+    if (undoSpillThreshold > 0) UndoSpill::Get(pdoc); // start accounting
+  }
+  /**
+   * Fills in the estimated number of bytes of undo data kept in memory and the
+   * number of bytes spilled to disk for the current document.
+   */
+  void GetUndoMemory(long *resident, long *spilled) {
+    UndoSpill *spill = UndoSpill::Find(pdoc);
+    if (resident) *resident = spill ? spill->GetResident() : 0;
+    if (spilled) *spilled = spill ? spill->GetSpilled() : 0;
+  }
+  /**
+   * Shows or hides a header of the fold parents of the first line in view.
+   * @param lines The maximum number of fold parents to show, or `0`.
+   */
+  void SetStickyHeader(int lines) { stickyLines = Platform::Maximum(lines, 0); }
+  /**
+   * Fills the given array with the fold parents of the given line, innermost
+   * first.
+   * Fold parents are looked up in an index that is created when first needed
+   * and updated as fold levels change.
+   * @param line The line to get the fold parents of.
+   * @param parents The array to fill with fold parent lines.
+   * @param n The maximum number of fold parents to fill in.
+   * @return number of fold parents filled in, or the number of fold parents if
+   *   the array is `NULL`
+   */
+  int GetFoldParents(int line, int *parents, int n) {
+    if (!foldParents) foldParents = new FoldParentIndex(pdoc);
+    return foldParents->GetParents(line, parents, n);
+  }
+  /** Returns the document currently shown by this Scintilla instance. */
+  Document *GetDocument() { return pdoc; }
 };
 
 // Link with C. Documentation in Scintilla.h.
@@ -1480,4 +3758,122 @@ void scintilla_refresh(Scintilla *sci) {
 void scintilla_delete(Scintilla *sci) {
   delete reinterpret_cast<ScintillaTerm *>(sci);
 }
+int scintilla_get_visible_lines(Scintilla *sci, int *lines, int *starts,
+                                int *ends, int *sublines, int n) {
+  return reinterpret_cast<ScintillaTerm *>(sci)->GetVisibleLines(lines, starts,
+                                                                 ends, sublines,
+                                                                 n);
+}
+int scintilla_get_style_runs(Scintilla *sci, int start, int end,
+                             int *positions, int *styles, int n) {
+  return reinterpret_cast<ScintillaTerm *>(sci)->GetStyleRuns(start, end,
+                                                              positions, styles,
+                                                              n);
+}
+void scintilla_set_minimap(Scintilla *sci, int width, int lines) {
+  reinterpret_cast<ScintillaTerm *>(sci)->SetMinimap(width, lines);
+}
+void scintilla_set_row_cache(Scintilla *sci, int size) {
+  reinterpret_cast<ScintillaTerm *>(sci)->SetRowCache(size);
+}
+void scintilla_set_undo_spill(Scintilla *sci, int threshold, int cap) {
+  reinterpret_cast<ScintillaTerm *>(sci)->SetUndoSpill(threshold, cap);
+}
+void scintilla_get_undo_memory(Scintilla *sci, long *resident,
+                               long *spilled) {
+  reinterpret_cast<ScintillaTerm *>(sci)->GetUndoMemory(resident, spilled);
+}
+ScintillaFilter *scintilla_filter_new(Scintilla *sci, int start, int end,
+                                      const char *command) {
+#if !_WIN32
+  Document *doc = reinterpret_cast<ScintillaTerm *>(sci)->GetDocument();
+  return reinterpret_cast<ScintillaFilter *>(new Filter(doc, start, end,
+                                                        command));
+#else
+  return NULL;
+#endif
+}
+int scintilla_filter_step(ScintillaFilter *filter, int timeout) {
+#if !_WIN32
+  return reinterpret_cast<Filter *>(filter)->Step(timeout);
+#else
+  return SCF_FAILED;
+#endif
+}
+void scintilla_filter_get_progress(ScintillaFilter *filter, int *written,
+                                   int *read) {
+#if !_WIN32
+  reinterpret_cast<Filter *>(filter)->GetProgress(written, read);
+#endif
+}
+void scintilla_filter_delete(ScintillaFilter *filter) {
+#if !_WIN32
+  delete reinterpret_cast<Filter *>(filter);
+#endif
+}
+void scintilla_set_sticky_header(Scintilla *sci, int lines) {
+  reinterpret_cast<ScintillaTerm *>(sci)->SetStickyHeader(lines);
+}
+int scintilla_get_fold_parents(Scintilla *sci, int line, int *parents, int n) {
+  return reinterpret_cast<ScintillaTerm *>(sci)->GetFoldParents(line, parents,
+                                                                n);
+}
+ScintillaChangeLog *scintilla_change_log_new(Scintilla *sci, int size) {
+  Document *doc = reinterpret_cast<ScintillaTerm *>(sci)->GetDocument();
+  return reinterpret_cast<ScintillaChangeLog *>(new ChangeLog(doc, size));
+}
+int scintilla_change_log_get_version(ScintillaChangeLog *log) {
+  return reinterpret_cast<ChangeLog *>(log)->GetVersion();
+}
+int scintilla_change_log_get_changes(ScintillaChangeLog *log, int version,
+                                     const ScintillaChange **changes) {
+  return reinterpret_cast<ChangeLog *>(log)->GetChanges(version, changes);
+}
+void scintilla_change_log_delete(ScintillaChangeLog *log) {
+  delete reinterpret_cast<ChangeLog *>(log);
+}
+ScintillaPositionTracker *scintilla_position_tracker_new(Scintilla *sci) {
+  Document *doc = reinterpret_cast<ScintillaTerm *>(sci)->GetDocument();
+  return reinterpret_cast<ScintillaPositionTracker *>(new PositionTracker(doc));
+}
+int scintilla_position_tracker_add(ScintillaPositionTracker *tracker, int pos,
+                                   bool rightGravity) {
+  return reinterpret_cast<PositionTracker *>(tracker)->Add(pos, rightGravity);
+}
+int scintilla_position_tracker_get(ScintillaPositionTracker *tracker, int id) {
+  return reinterpret_cast<PositionTracker *>(tracker)->Get(id);
+}
+void scintilla_position_tracker_remove(ScintillaPositionTracker *tracker,
+                                       int id) {
+  reinterpret_cast<PositionTracker *>(tracker)->Remove(id);
+}
+int scintilla_position_tracker_get_all(ScintillaPositionTracker *tracker,
+                                       int *ids, int *positions, int n) {
+  return reinterpret_cast<PositionTracker *>(tracker)->GetAll(ids, positions,
+                                                              n);
+}
+void scintilla_position_tracker_delete(ScintillaPositionTracker *tracker) {
+  delete reinterpret_cast<PositionTracker *>(tracker);
+}
+ScintillaEncodingIndex *scintilla_encoding_index_new(Scintilla *sci) {
+  Document *doc = reinterpret_cast<ScintillaTerm *>(sci)->GetDocument();
+  return reinterpret_cast<ScintillaEncodingIndex *>(new EncodingIndex(doc));
+}
+int scintilla_encoding_index_get_units(ScintillaEncodingIndex *index, int unit,
+                                       const int *positions, int *lines,
+                                       int *units, int n) {
+  return reinterpret_cast<EncodingIndex *>(index)->GetUnits(unit, positions,
+                                                            lines, units, n);
+}
+int scintilla_encoding_index_get_positions(ScintillaEncodingIndex *index,
+                                           int unit, const int *lines,
+                                           const int *units, int *positions,
+                                           int n) {
+  return reinterpret_cast<EncodingIndex *>(index)->GetPositions(unit, lines,
+                                                                units,
+                                                                positions, n);
+}
+void scintilla_encoding_index_delete(ScintillaEncodingIndex *index) {
+  delete reinterpret_cast<EncodingIndex *>(index);
+}
 }
@@ -105,6 +105,335 @@ void scintilla_refresh(Scintilla *sci);
  * @param sci The Scintilla window returned by `scintilla_new()`.
  */
 void scintilla_delete(Scintilla *sci);
+/**
+ * Fills the given arrays with the document line, start position, end position,
+ * and wrapped sub-line index of each display line on the screen, starting with
+ * the first visible line.
+ * Any of the arrays may be `NULL`.
+ * Curses must have been initialized prior to calling this function.
+ * @param sci The Scintilla window returned by `scintilla_new()`.
+ * @param lines The array to fill with document lines.
+ * @param starts The array to fill with display line start positions.
+ * @param ends The array to fill with display line end positions.
+ * @param sublines The array to fill with wrapped sub-line indices.
+ * @param n The maximum number of display lines to fill in.
+ * @return number of display lines filled in
+ */
+int scintilla_get_visible_lines(Scintilla *sci, int *lines, int *starts,
+                                int *ends, int *sublines, int n);
+/**
+ * Fills the given arrays with the start position and style of each run of
+ * identically styled characters in the given range.
+ * A run ends where the next one starts, or at the end of the range.
+ * Call with `NULL` arrays first to get the number of runs in the range.
+ * Curses does not have to be initialized before calling this function.
+ * @param sci The Scintilla window returned by `scintilla_new()`.
+ * @param start The start position of the range.
+ * @param end The end position of the range.
+ * @param positions The array to fill with run start positions.
+ * @param styles The array to fill with run styles.
+ * @param n The maximum number of runs to fill in.
+ * @return number of runs filled in, or the number of runs in the range if
+ *   either array is `NULL`
+ */
+int scintilla_get_style_runs(Scintilla *sci, int start, int end,
+                             int *positions, int *styles, int n);
+/**
+ * Shows or hides a minimap of the document in the given Scintilla window.
+ * The minimap is a column of braille characters drawn in the right margin that
+ * shows the shape and dominant colors of the document's lines. The lines on the
+ * screen are highlighted, and clicking on the minimap scrolls to the lines
+ * clicked on.
+ * Curses does not have to be initialized before calling this function.
+ * @param sci The Scintilla window returned by `scintilla_new()`.
+ * @param width The width of the minimap, or `0` to hide it.
+ * @param lines The number of document lines each row of minimap dots
+ *   summarizes.
+ */
+void scintilla_set_minimap(Scintilla *sci, int width, int lines);
+/**
+ * Sets the amount of memory the given Scintilla window may use to cache
+ * painted rows, or disables the row cache.
+ * When the view returns to lines that have not changed since they were last
+ * painted, such as when scrolling back and forth, those rows are copied from
+ * the cache instead of being laid out and drawn again. Rows with the caret or
+ * selection on them are always drawn. The least recently used rows are
+ * discarded when the cache is full. The cache is disabled by default.
+ * Curses does not have to be initialized before calling this function.
+ * @param sci The Scintilla window returned by `scintilla_new()`.
+ * @param size The maximum number of bytes to cache, or `0` to disable the
+ *   cache.
+ */
+void scintilla_set_row_cache(Scintilla *sci, int size);
+/**
+ * Sets the size of edits whose undo data the given Scintilla window writes to a
+ * temporary file instead of keeping in memory, and the amount of undo data
+ * kept in memory above which edits are always written to the file.
+ * Only `SCI_REPLACETARGET` and `SCI_SETTEXT` edits made outside of an undo
+ * action are written to the file. Their text is read back when they are undone
+ * or redone. Such edits are recorded in the undo history as container actions
+ * with negative tokens, which applications should ignore.
+ * The cap is not a hard limit: typing, pasting, and edits made inside an undo
+ * action are always kept in memory, and only count towards the cap.
+ * Undo data is only written to the file while undo collection is on.
+ * Curses does not have to be initialized before calling this function.
+ * @param sci The Scintilla window returned by `scintilla_new()`.
+ * @param threshold The size in bytes of the text removed and inserted by an
+ *   edit at which to write undo data to the file, or `0` to disable writing
+ *   undo data to the file.
+ * @param cap The size in bytes of the undo data kept in memory that an edit
+ *   must not go over without writing its undo data to the file regardless of
+ *   its size, or `0` for no limit.
+ */
+void scintilla_set_undo_spill(Scintilla *sci, int threshold, int cap);
+/**
+ * Fills in the number of bytes of text the given Scintilla window's document
+ * keeps in memory for undoing and redoing, and the number of bytes it has
+ * written to a temporary file, since its undo buffer was last emptied.
+ * Text discarded from the undo history, like undone edits followed by a new
+ * edit, is no longer counted. Scintilla's own overhead per undo action is not
+ * counted either.
+ * Both are `0` unless undo data is being written to a file, as set by
+ * `scintilla_set_undo_spill()`.
+ * Curses does not have to be initialized before calling this function.
+ * @param sci The Scintilla window returned by `scintilla_new()`.
+ * @param resident The long integer to put the number of bytes kept in memory
+ *   in.
+ * @param spilled The long integer to put the number of bytes written to file
+ *   in.
+ */
+void scintilla_get_undo_memory(Scintilla *sci, long *resident, long *spilled);
+/**
+ * Sets the maximum number of rows at the top of the given Scintilla window
+ * that show the fold parents of the first line below them, outermost first.
+ * Clicking on one of these rows moves the caret to its line.
+ * The default is `0`, which hides the header.
+ * @param sci The Scintilla window returned by `scintilla_new()`.
+ * @param lines The maximum number of header rows to show.
+ */
+void scintilla_set_sticky_header(Scintilla *sci, int lines);
+/**
+ * Fills the given array with the fold parents of the given line in the given
+ * Scintilla window's document, innermost first, and returns how many were
+ * filled in.
+ * If the array is `NULL`, returns the number of fold parents the line has.
+ * Curses does not have to be initialized before calling this function.
+ * @param sci The Scintilla window returned by `scintilla_new()`.
+ * @param line The line number to get the fold parents of.
+ * @param parents The array of integers to put fold parent line numbers in.
+ * @param n The number of elements in the array.
+ * @return number of fold parents filled in
+ */
+int scintilla_get_fold_parents(Scintilla *sci, int line, int *parents, int n);
+
+/**
+ * A change made to a document: `deleted` bytes at `position` were replaced by
+ * the `inserted` bytes of `text`.
+ * `text` is not null-terminated and may contain null bytes.
+ */
+typedef struct {
+  int position;
+  int deleted;
+  int inserted;
+  const char *text;
+} ScintillaChange;
+typedef void *ScintillaChangeLog;
+/**
+ * Creates a new log of the changes made to the document the given Scintilla
+ * window currently shows.
+ * The log stays with that document even if the window later shows another one.
+ * Each change to the document increments its version, starting from `0` when
+ * the log is created.
+ * Curses does not have to be initialized before calling this function.
+ * @param sci The Scintilla window returned by `scintilla_new()`.
+ * @param size The maximum number of bytes the log may use. The oldest changes
+ *   are dropped when the log grows beyond this size.
+ */
+ScintillaChangeLog *scintilla_change_log_new(Scintilla *sci, int size);
+/**
+ * Returns the current version of the given change log's document.
+ * @param log The change log returned by `scintilla_change_log_new()`.
+ * @return document version
+ */
+int scintilla_change_log_get_version(ScintillaChangeLog *log);
+/**
+ * Points the given pointer at the changes made to the given change log's
+ * document since the given version and returns their number.
+ * Changes are to be applied in order, and adjacent changes are merged.
+ * The changes are valid until the next call to this function or until the log
+ * is deleted.
+ * @param log The change log returned by `scintilla_change_log_new()`.
+ * @param version The version to get changes since, usually the version
+ *   returned by the last call to `scintilla_change_log_get_version()`.
+ * @param changes The pointer to point at the changes.
+ * @return number of changes, or `-1` if the changes since the given version
+ *   were dropped or the document was deleted, in which case the full text needs
+ *   to be read again
+ */
+int scintilla_change_log_get_changes(ScintillaChangeLog *log, int version,
+                                     const ScintillaChange **changes);
+/**
+ * Deletes the given change log.
+ * @param log The change log returned by `scintilla_change_log_new()`.
+ */
+void scintilla_change_log_delete(ScintillaChangeLog *log);
+
+typedef void *ScintillaFilter;
+/**
+ * Starts filtering the given range of the document the given Scintilla window
+ * currently shows through the given shell command.
+ * The range is streamed to the command's standard input while its standard
+ * output is collected, and the document is read-only until filtering stops.
+ * Call `scintilla_filter_step()` repeatedly, for example from an event loop,
+ * until filtering is done. If the command exits successfully, its output
+ * replaces the range as a single undo action.
+ * Not supported on Windows, where `NULL` is returned.
+ * Curses does not have to be initialized before calling this function.
+ * @param sci The Scintilla window returned by `scintilla_new()`.
+ * @param start The start position of the range to filter.
+ * @param end The end position of the range to filter.
+ * @param command The shell command to filter the range through. Its standard
+ *   error is discarded.
+ */
+ScintillaFilter *scintilla_filter_new(Scintilla *sci, int start, int end,
+                                      const char *command);
+/**
+ * Streams as much of the given filter's range to its command and reads as
+ * much of its output as possible without waiting longer than the given
+ * timeout, replacing the range if the command has exited successfully.
+ * @param filter The filter returned by `scintilla_filter_new()`.
+ * @param timeout The number of milliseconds to wait for the command, `0` to
+ *   not wait, or `-1` to wait until the command is ready.
+ * @return `SCF_RUNNING` if filtering is still in progress, `SCF_DONE` if the
+ *   range was replaced, or `SCF_FAILED` if the command could not be started,
+ *   did not exit successfully, or the document was deleted
+ */
+int scintilla_filter_step(ScintillaFilter *filter, int timeout);
+/**
+ * Fills in the number of bytes of the given filter's range written to its
+ * command and the number of bytes of output read from it so far.
+ * @param filter The filter returned by `scintilla_filter_new()`.
+ * @param written The integer to put the number of bytes written in.
+ * @param read The integer to put the number of bytes read in.
+ */
+void scintilla_filter_get_progress(ScintillaFilter *filter, int *written,
+                                   int *read);
+/**
+ * Deletes the given filter, cancelling it and killing its command if it is
+ * still running.
+ * The range is left as it was.
+ * @param filter The filter returned by `scintilla_filter_new()`.
+ */
+void scintilla_filter_delete(ScintillaFilter *filter);
+
+typedef void *ScintillaPositionTracker;
+/**
+ * Creates a new position tracker for the document the given Scintilla window
+ * currently shows.
+ * Tracked positions follow that document's edits, even if the window later
+ * shows another document: positions after an edit shift with it, and positions
+ * inside deleted text move to the start of the deletion.
+ * Curses does not have to be initialized before calling this function.
+ * @param sci The Scintilla window returned by `scintilla_new()`.
+ */
+ScintillaPositionTracker *scintilla_position_tracker_new(Scintilla *sci);
+/**
+ * Starts tracking the given position and returns its ID.
+ * IDs of removed positions are reused.
+ * @param tracker The position tracker returned by
+ *   `scintilla_position_tracker_new()`.
+ * @param pos The position to track.
+ * @param rightGravity Whether text inserted at the position is inserted before
+ *   it (`true`) or after it (`false`).
+ * @return position ID
+ */
+int scintilla_position_tracker_add(ScintillaPositionTracker *tracker, int pos,
+                                   bool rightGravity);
+/**
+ * Returns the current position of the given tracked position ID.
+ * @param tracker The position tracker returned by
+ *   `scintilla_position_tracker_new()`.
+ * @param id The position ID returned by `scintilla_position_tracker_add()`.
+ * @return position, or `-1` if the ID is not tracked
+ */
+int scintilla_position_tracker_get(ScintillaPositionTracker *tracker, int id);
+/**
+ * Stops tracking the given position ID.
+ * @param tracker The position tracker returned by
+ *   `scintilla_position_tracker_new()`.
+ * @param id The position ID returned by `scintilla_position_tracker_add()`.
+ */
+void scintilla_position_tracker_remove(ScintillaPositionTracker *tracker,
+                                       int id);
+/**
+ * Fills the given arrays with the IDs and current positions of tracked
+ * positions, in position order.
+ * Call with `NULL` arrays first to get the number of tracked positions.
+ * @param tracker The position tracker returned by
+ *   `scintilla_position_tracker_new()`.
+ * @param ids The array to fill with position IDs.
+ * @param positions The array to fill with positions.
+ * @param n The maximum number of positions to fill in.
+ * @return number of positions filled in, or the number of tracked positions if
+ *   either array is `NULL`
+ */
+int scintilla_position_tracker_get_all(ScintillaPositionTracker *tracker,
+                                       int *ids, int *positions, int n);
+/**
+ * Deletes the given position tracker.
+ * @param tracker The position tracker returned by
+ *   `scintilla_position_tracker_new()`.
+ */
+void scintilla_position_tracker_delete(ScintillaPositionTracker *tracker);
+
+typedef void *ScintillaEncodingIndex;
+/**
+ * Creates a new index of the UTF-16 code units, code points, and display
+ * columns in the UTF-8 document the given Scintilla window currently shows.
+ * The index is kept up to date as that document changes, even if the window
+ * later shows another document.
+ * Curses does not have to be initialized before calling this function.
+ * @param sci The Scintilla window returned by `scintilla_new()`.
+ */
+ScintillaEncodingIndex *scintilla_encoding_index_new(Scintilla *sci);
+/**
+ * Converts the given positions into lines and the number of the given units
+ * from the start of those lines to those positions.
+ * @param index The index returned by `scintilla_encoding_index_new()`.
+ * @param unit The unit to convert to: `SCU_BYTES`, `SCU_UTF16`,
+ *   `SCU_CODEPOINTS`, or `SCU_COLUMNS`.
+ * @param positions The positions to convert.
+ * @param lines The array to fill with lines. May be `NULL`.
+ * @param units The array to fill with units from the start of lines.
+ * @param n The number of positions to convert.
+ * @return number of positions converted
+ */
+int scintilla_encoding_index_get_units(ScintillaEncodingIndex *index, int unit,
+                                       const int *positions, int *lines,
+                                       int *units, int n);
+/**
+ * Converts the given lines and numbers of the given units from the start of
+ * those lines into positions.
+ * Units in the middle of a character convert to the start of that character,
+ * and units past the end of a line convert to the end of that line.
+ * @param index The index returned by `scintilla_encoding_index_new()`.
+ * @param unit The unit to convert from: `SCU_BYTES`, `SCU_UTF16`,
+ *   `SCU_CODEPOINTS`, or `SCU_COLUMNS`.
+ * @param lines The lines to convert.
+ * @param units The units from the start of lines to convert.
+ * @param positions The array to fill with positions.
+ * @param n The number of lines and units to convert.
+ * @return number of positions converted
+ */
+int scintilla_encoding_index_get_positions(ScintillaEncodingIndex *index,
+                                           int unit, const int *lines,
+                                           const int *units, int *positions,
+                                           int n);
+/**
+ * Deletes the given encoding index.
+ * @param index The index returned by `scintilla_encoding_index_new()`.
+ */
+void scintilla_encoding_index_delete(ScintillaEncodingIndex *index);
 
 /**
  * Returns the curses `COLOR_PAIR` for the given curses foreground and
@@ -125,6 +454,17 @@ void scintilla_delete(Scintilla *sci);
 #define SCM_DRAG 2
 #define SCM_RELEASE 3
 
+#define SCU_BYTES 0
+#define SCU_UTF16 1
+#define SCU_CODEPOINTS 2
+#define SCU_COLUMNS 3
+
+#define SCF_FAILED -1
+#define SCF_RUNNING 0
+#define SCF_DONE 1
+
+#define SCFIND_LINEAR 0x10000000
+
 #ifdef __cplusplus
 }
 #endif
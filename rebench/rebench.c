@@ -0,0 +1,200 @@
+// Copyright 2012-2016 Mitchell mitchell.att.foicica.com. See LICENSE.
+// Compares Scinterm's linear-time regex engine (`SCFIND_LINEAR`) with
+// Scintilla's backtracking `RESearch` engine.
+// First checks that both engines find the same matches for searches of partial
+// ranges (anchors, word boundaries, groups, lazy repetition, and backwards
+// searches). Then times searching a large generated log forwards and backwards,
+// and long lines that make `RESearch` backtrack. The report is printed after
+// curses ends.
+
+#include <locale.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/time.h>
+#include <curses.h>
+
+#include "Scintilla.h"
+#include "ScintillaTerm.h"
+
+#define SSM(m, w, l) scintilla_send_message(sci, m, w, l)
+
+static Scintilla *sci;
+static char report[1 << 16];
+static size_t reportLength;
+static int failures;
+
+void scnotification(Scintilla *view, int msg, void *lParam, void *wParam) {}
+
+// Appends to the report printed after curses ends.
+static void say(const char *format, ...) {
+  va_list args;
+  va_start(args, format);
+  int n = vsnprintf(report + reportLength, sizeof(report) - reportLength,
+                    format, args);
+  if (n > 0) reportLength += n;
+  if (reportLength >= sizeof(report)) reportLength = sizeof(report) - 1;
+  va_end(args);
+}
+
+static double now() {
+  struct timeval time = {0, 0};
+  gettimeofday(&time, NULL);
+  return time.tv_sec + time.tv_usec / 1e6;
+}
+
+// Searches the given range for the given expression, searching backwards if
+// start is greater than end. Returns the match position, or -1, and fills in
+// the match length.
+static int search(const char *re, int flags, int start, int end, int *length) {
+  SSM(SCI_SETSEARCHFLAGS, flags, 0);
+  SSM(SCI_SETTARGETSTART, start, 0), SSM(SCI_SETTARGETEND, end, 0);
+  int pos = SSM(SCI_SEARCHINTARGET, strlen(re), (sptr_t)re);
+  *length = (pos >= 0) ? SSM(SCI_GETTARGETEND, 0, 0) - pos : 0;
+  return pos;
+}
+
+// Counts the non-overlapping matches of the given expression in the document.
+static int count(const char *re, int flags) {
+  int n = 0, pos = 0, length = 0, end = SSM(SCI_GETLENGTH, 0, 0);
+  while (pos <= end && (pos = search(re, flags, pos, end, &length)) >= 0)
+    n++, pos += (length > 0) ? length : 1;
+  return n;
+}
+
+// Returns the given short text with line endings escaped for the report.
+static const char *escape(const char *text) {
+  static char escaped[64];
+  char *p = escaped;
+  for (; *text && p < escaped + sizeof(escaped) - 3; text++)
+    if (*text == '\n' || *text == '\r')
+      *p++ = '\\', *p++ = (*text == '\n') ? 'n' : 'r';
+    else
+      *p++ = *text;
+  *p = '\0';
+  return escaped;
+}
+
+// Times searching backwards from the end of the document for the given
+// expression with both engines.
+static void benchBackward(const char *re) {
+  double seconds[2];
+  int pos[2], length;
+  for (int i = 0; i < 2; i++) {
+    double start = now();
+    pos[i] = search(re, SCFIND_REGEXP | SCFIND_MATCHCASE |
+                        (i ? SCFIND_LINEAR : 0), SSM(SCI_GETLENGTH, 0, 0), 0,
+                    &length);
+    seconds[i] = now() - start;
+  }
+  if (pos[0] != pos[1]) failures++;
+  say("%-36s RESearch %9d in %7.3fs, linear %9d in %7.3fs\n", re, pos[0],
+      seconds[0], pos[1], seconds[1]);
+}
+
+// Searches the given text with both engines and reports whether or not they
+// found the same match and first group.
+static void check(const char *text, const char *re, int flags, int start,
+                  int end) {
+  SSM(SCI_SETTEXT, 0, (sptr_t)text);
+  char tags[2][256];
+  int pos[2], length[2];
+  for (int i = 0; i < 2; i++) {
+    pos[i] = search(re, SCFIND_REGEXP | flags | (i ? SCFIND_LINEAR : 0), start,
+                    end, &length[i]);
+    SSM(SCI_GETTAG, 1, (sptr_t)tags[i]);
+  }
+  int same = pos[0] == pos[1] && length[0] == length[1] &&
+             (pos[0] < 0 || strcmp(tags[0], tags[1]) == 0);
+  if (!same) failures++;
+  say("%-8s %-22s %-14s %d..%d: RESearch %d+%d, linear %d+%d\n",
+      same ? "ok" : "MISMATCH", re, escape(text), start, end, pos[0], length[0],
+      pos[1], length[1]);
+}
+
+// Times counting the matches of the given expression with both engines.
+static void bench(const char *re) {
+  double seconds[2];
+  int n[2];
+  for (int i = 0; i < 2; i++) {
+    double start = now();
+    n[i] = count(re, SCFIND_REGEXP | SCFIND_MATCHCASE |
+                     (i ? SCFIND_LINEAR : 0));
+    seconds[i] = now() - start;
+  }
+  if (n[0] != n[1]) failures++;
+  say("%-36s RESearch %7d in %7.3fs, linear %7d in %7.3fs\n", re, n[0],
+      seconds[0], n[1], seconds[1]);
+}
+
+int main(int argc, char **argv) {
+  int lines = (argc > 1) ? atoi(argv[1]) : 200000;
+  setlocale(LC_CTYPE, "");
+  initscr();
+  sci = scintilla_new(scnotification);
+  SSM(SCI_SETUNDOCOLLECTION, 0, 0);
+
+  say("Checking matches of partial ranges:\n");
+  check("xfoo", "^foo", SCFIND_MATCHCASE, 1, 4);
+  check("x\nfoo", "^foo", SCFIND_MATCHCASE, 2, 5);
+  check("x\nfoo", "^foo", SCFIND_MATCHCASE, 0, 5);
+  check("foox", "foo$", SCFIND_MATCHCASE, 0, 3);
+  check("foo\nx", "foo$", SCFIND_MATCHCASE, 0, 3);
+  check("foo\r\nx", "foo$", SCFIND_MATCHCASE, 0, 5);
+  check("ab abc", "\\<ab\\>", SCFIND_MATCHCASE, 0, 6);
+  check("ab abc", "ab\\>", SCFIND_MATCHCASE, 3, 6);
+  check("abc", "\\<bc", SCFIND_MATCHCASE, 1, 3);
+  check("abc", "ab\\>", SCFIND_MATCHCASE, 0, 2);
+  check("abc abc", "\\<bc", SCFIND_MATCHCASE, 7, 1);
+  check("a1 b22 c333", "[a-z]\\([0-9]+\\)", SCFIND_MATCHCASE, 2, 11);
+  check("a1 b22 c333", "[a-z]([0-9]+)", SCFIND_MATCHCASE | SCFIND_POSIX, 2,
+        11);
+  check("abcabc", "b.", SCFIND_MATCHCASE, 6, 0);
+  check("one\ntwo\nthree", "^t\\w*", SCFIND_MATCHCASE, 13, 0);
+  check("Foo fOO", "fo+", 0, 0, 7);
+  check("x = y;", "[^ ]+;$", SCFIND_MATCHCASE, 0, 6);
+  check("aaa", "a*", SCFIND_MATCHCASE, 1, 3);
+  check("<a><b>", "<.*?>", SCFIND_MATCHCASE, 0, 6);
+  check("<a><b>", "<.+?>", SCFIND_MATCHCASE, 6, 0);
+  check("x = [1], [2];", "\\[\\(.+?\\)\\];", SCFIND_MATCHCASE, 0, 13);
+  check("aaa", "a+?", SCFIND_MATCHCASE, 0, 3);
+
+  say("\nSearching a log of %d lines:\n", lines);
+  char line[256];
+  for (int i = 0; i < lines; i++) {
+    snprintf(line, sizeof(line),
+             "2016-05-%02d %02d:%02d:%02d %s [worker-%d] request %d took %d ms "
+             "from 10.0.%d.%d\n", i % 28 + 1, i / 3600 % 24, i / 60 % 60,
+             i % 60, (i % 997 == 0) ? "ERROR" : "INFO", i % 32,
+             i * 7919 % 100000, i * 31 % 1000, i % 256, i * 13 % 256);
+    SSM(SCI_APPENDTEXT, strlen(line), (sptr_t)line);
+  }
+  bench("ERROR");
+  bench("took [0-9]+ ms");
+  bench("^2016-05-1[0-9] 1[0-9]:");
+  bench("worker-\\([0-9]+\\)\\] request");
+  bench("[0-9]+\\.[0-9]+\\.[0-9]+\\.[0-9]+$");
+  bench("\\<request [0-9]*9 took 9[0-9][0-9] ms");
+
+  say("\nSearching the log backwards from its end:\n");
+  benchBackward("ERROR");
+  benchBackward("request [0-9]+ took 99[0-9] ms");
+  benchBackward("^2016-05-01 00:00:0[0-9]");
+
+  say("\nSearching long lines of 'a' for a*a*c:\n");
+  for (int n = 250; n <= 2000; n *= 2) {
+    char *text = malloc(n + 1);
+    memset(text, 'a', n), text[n] = '\0';
+    SSM(SCI_SETTEXT, 0, (sptr_t)text);
+    free(text);
+    say("%5d: ", n);
+    bench("a*a*c");
+  }
+
+  scintilla_delete(sci);
+  endwin();
+  fputs(report, stdout);
+  printf("\n%d mismatch(es)\n", failures);
+  return failures ? 1 : 0;
+}